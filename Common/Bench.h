@@ -0,0 +1,226 @@
+/******************************************************************************
+** Program name: Shared benchmark helpers: statistical timing engine
+** Description: This header file times a kernel repeatedly and summarizes the
+    samples: warm-up runs, median and p5/p95/p99 percentiles, a 95% confidence
+    interval of the mean, outlier rejection, and run-until-stable stopping.
+    Every benchmark main reports through it instead of its own NUMTRIES loop.
+    The BENCH_* defaults can be overridden with -D when compiling.
+******************************************************************************/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <omp.h>
+
+// untimed runs before sampling starts (page faults, cache and frequency warm-up):
+#ifndef BENCH_WARMUPS
+#define BENCH_WARMUPS       2
+#endif
+
+// always take at least this many timed samples ...
+#ifndef BENCH_MINRUNS
+#define BENCH_MINRUNS       10
+#endif
+
+// ... and never more than this many:
+#ifndef BENCH_MAXRUNS
+#define BENCH_MAXRUNS       200
+#endif
+
+// stop sampling once this much time has been spent in timed runs:
+#ifndef BENCH_MAXSECONDS
+#define BENCH_MAXSECONDS    10.
+#endif
+
+// stable = the 95% CI half-width of the mean is below this fraction of the mean:
+#ifndef BENCH_TARGETCI
+#define BENCH_TARGETCI      0.01
+#endif
+
+// samples farther than this many scaled MADs from the median are outliers (0 keeps all):
+#ifndef BENCH_OUTLIERMADS
+#define BENCH_OUTLIERMADS   5.
+#endif
+
+struct BenchConfig
+{
+    int     warmups;
+    int     minRuns;
+    int     maxRuns;
+    double  maxSeconds;
+    double  targetCI;
+    double  outlierMADs;
+};
+
+#define BENCH_DEFAULTS  { BENCH_WARMUPS, BENCH_MINRUNS, BENCH_MAXRUNS, BENCH_MAXSECONDS, BENCH_TARGETCI, BENCH_OUTLIERMADS }
+
+// all times are in seconds; the percentiles describe every sample (tails included),
+// while the mean, standard deviation and confidence interval use only the kept samples:
+struct BenchStats
+{
+    int     runs;               // timed samples taken
+    int     kept;               // samples left after outlier rejection
+    int     stable;             // 1 if the CI target was met before the run or time limit
+    double  min, max;
+    double  median, p5, p95, p99;
+    double  mean, stddev;
+    double  ciLow, ciHigh;      // 95% confidence interval of the mean
+};
+
+typedef void (*BenchFunc)( void *arg );
+
+static inline int
+BenchCompare( const void *a, const void *b )
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return ( x > y ) - ( x < y );
+}
+
+// percentile of sorted samples, linearly interpolated between the two nearest ranks:
+static inline double
+BenchPercentile( const double *sorted, int n, double pct )
+{
+    if( n == 1 )
+        return sorted[0];
+    double pos = pct / 100. * (double)( n - 1 );
+    int lo = (int)pos;
+    if( lo >= n-1 )
+        return sorted[n-1];
+    double frac = pos - (double)lo;
+    return sorted[lo] + frac * ( sorted[lo+1] - sorted[lo] );
+}
+
+// two-sided 95% Student-t quantile for df degrees of freedom:
+static inline double
+BenchT95( int df )
+{
+    static const double T95[ ] = { 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+    if( df < 1 )
+        return 0.;
+    if( df <= 30 )
+        return T95[df-1];
+    return 1.960 + 2.4 / (double)df;        // within 0.002 of the exact value above 30
+}
+
+// summarize n samples into stats (scratch must hold n doubles):
+static inline void
+BenchSummarize( const double *samples, int n, double outlierMADs, double *scratch, struct BenchStats *stats )
+{
+    for( int i = 0; i < n; i++ )
+        scratch[i] = samples[i];
+    qsort( scratch, n, sizeof(double), BenchCompare );
+
+    stats->runs   = n;
+    stats->min    = scratch[0];
+    stats->max    = scratch[n-1];
+    stats->median = BenchPercentile( scratch, n, 50. );
+    stats->p5     = BenchPercentile( scratch, n,  5. );
+    stats->p95    = BenchPercentile( scratch, n, 95. );
+    stats->p99    = BenchPercentile( scratch, n, 99. );
+
+    // median absolute deviation, scaled to match a standard deviation for normal data:
+    double limit = HUGE_VAL;
+    if( outlierMADs > 0. )
+    {
+        for( int i = 0; i < n; i++ )
+            scratch[i] = fabs( samples[i] - stats->median );
+        qsort( scratch, n, sizeof(double), BenchCompare );
+        double mad = 1.4826 * BenchPercentile( scratch, n, 50. );
+        limit = outlierMADs * mad;
+
+        // very tight distributions have a tiny MAD; never reject within 2% of the median:
+        if( limit < 0.02 * stats->median )
+            limit = 0.02 * stats->median;
+    }
+
+    double sum = 0., sumSq = 0.;
+    int kept = 0;
+    for( int i = 0; i < n; i++ )
+    {
+        if( fabs( samples[i] - stats->median ) > limit )
+            continue;
+        sum += samples[i];
+        kept++;
+    }
+    double mean = sum / (double)kept;
+    for( int i = 0; i < n; i++ )
+    {
+        if( fabs( samples[i] - stats->median ) > limit )
+            continue;
+        sumSq += ( samples[i] - mean ) * ( samples[i] - mean );
+    }
+
+    stats->kept   = kept;
+    stats->mean   = mean;
+    stats->stddev = kept > 1 ? sqrt( sumSq / (double)( kept - 1 ) ) : 0.;
+    double half   = kept > 1 ? BenchT95( kept - 1 ) * stats->stddev / sqrt( (double)kept ) : 0.;
+    stats->ciLow  = mean - half;
+    stats->ciHigh = mean + half;
+}
+
+// time func(arg) until the confidence interval is tight enough or a limit is reached:
+static inline void
+BenchRun( const struct BenchConfig *cfg, BenchFunc func, void *arg, struct BenchStats *stats )
+{
+    double *samples = (double *)malloc( 2 * cfg->maxRuns * sizeof(double) );
+    double *scratch = samples + cfg->maxRuns;
+
+    for( int w = 0; w < cfg->warmups; w++ )
+        func( arg );
+
+    int n = 0;
+    double elapsed = 0.;
+    stats->stable = 0;
+    while( n < cfg->maxRuns )
+    {
+        double time0 = omp_get_wtime( );
+        func( arg );
+        double time1 = omp_get_wtime( );
+
+        samples[n++] = time1 - time0;
+        elapsed += time1 - time0;
+
+        if( n >= cfg->minRuns )
+        {
+            BenchSummarize( samples, n, cfg->outlierMADs, scratch, stats );
+            if( stats->ciHigh - stats->mean <= cfg->targetCI * stats->mean )
+            {
+                stats->stable = 1;
+                break;
+            }
+            if( elapsed >= cfg->maxSeconds )
+                break;
+        }
+    }
+    if( n < cfg->minRuns )
+        BenchSummarize( samples, n, cfg->outlierMADs, scratch, stats );
+
+    free( samples );
+}
+
+// the relative 95% CI half-width of the mean, as a percentage:
+static inline double
+BenchCIPercent( const struct BenchStats *stats )
+{
+    return 100. * ( stats->ciHigh - stats->mean ) / stats->mean;
+}
+
+// print the standard summary block; work is the amount of "unit" done by one run:
+static inline void
+BenchPrint( const struct BenchStats *stats, double work, const char *unit )
+{
+    printf( "Runs             = %8d (%d kept, %s)\n", stats->runs, stats->kept, stats->stable ? "stable" : "not stable" );
+    printf( "Median time      = %8.2lf usec (p5 %.2lf, p95 %.2lf, p99 %.2lf)\n",
+        stats->median*1.e6, stats->p5*1.e6, stats->p95*1.e6, stats->p99*1.e6 );
+    printf( "Mean time        = %8.2lf usec +- %.2lf%% (95%% CI)\n", stats->mean*1.e6, BenchCIPercent( stats ) );
+    printf( "Median perf      = %8.2lf Mega%s/Sec\n", work / stats->median / 1.e6, unit );
+    printf( "Peak perf        = %8.2lf Mega%s/Sec\n", work / stats->min / 1.e6, unit );
+}
+
+#endif
@@ -0,0 +1,199 @@
+/******************************************************************************
+** Program name: Shared benchmark helpers: cache sizes and streaming stores
+** Description: This header file reads the data cache sizes of cpu 0 from /sys,
+    finds the cache boundaries in a throughput-versus-working-set sweep, and
+    provides an array multiply that writes its result with non-temporal
+    (streaming) stores, which skip the read-for-ownership of the destination
+    once the arrays no longer fit in the last-level cache.
+******************************************************************************/
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <immintrin.h>
+
+#define CACHE_MAXLEVELS     4
+
+// working-set sweeps step by 2^(1/CACHE_STEPSPEROCTAVE):
+#define CACHE_STEPSPEROCTAVE    4
+#define CACHE_MAXPOINTS         160
+
+// a plateau ends when throughput falls this far below its best level so far and stays
+// there for CACHE_PERSIST points; the drop continues while each step loses CACHE_SLOPE more:
+#define CACHE_DROP              0.15
+#define CACHE_PERSIST           3
+#define CACHE_SLOPE             0.03
+
+// size in bytes of the data (or unified) cache at a level, or 0 if it is not reported:
+static inline size_t
+CacheSize( int level )
+{
+    char path[128];
+    for( int index = 0; index < 16; index++ )
+    {
+        snprintf( path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/level", index );
+        FILE *fp = fopen( path, "r" );
+        if( fp == NULL )
+            break;
+        int thisLevel = 0;
+        if( fscanf( fp, "%d", &thisLevel ) != 1 )
+            thisLevel = 0;
+        fclose( fp );
+        if( thisLevel != level )
+            continue;
+
+        char type[32] = "";
+        snprintf( path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/type", index );
+        fp = fopen( path, "r" );
+        if( fp == NULL || fscanf( fp, "%31s", type ) != 1 )
+            type[0] = '\0';
+        if( fp != NULL )
+            fclose( fp );
+        if( strcmp( type, "Instruction" ) == 0 )
+            continue;
+
+        // sizes look like "48K" or "105M":
+        size_t size = 0;
+        char unit = '\0';
+        snprintf( path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/size", index );
+        fp = fopen( path, "r" );
+        if( fp == NULL )
+            return 0;
+        if( fscanf( fp, "%zu%c", &size, &unit ) < 1 )
+            size = 0;
+        fclose( fp );
+        if( unit == 'K' )   size *= 1024;
+        if( unit == 'M' )   size *= 1024*1024;
+        if( unit == 'G' )   size *= 1024*1024*1024;
+        return size;
+    }
+    return 0;
+}
+
+// size in bytes of the highest cache level that is reported (0 if none is):
+static inline size_t
+LastLevelCacheSize( )
+{
+    for( int level = CACHE_MAXLEVELS; level >= 1; level-- )
+    {
+        size_t size = CacheSize( level );
+        if( size > 0 )
+            return size;
+    }
+    return 0;
+}
+
+// fill ws[] with working-set sizes from minBytes to maxBytes on a log scale; returns the count:
+static inline int
+CacheSweepSizes( double minBytes, double maxBytes, double *ws )
+{
+    int n = 0;
+    for( int k = 0; n < CACHE_MAXPOINTS; k++ )
+    {
+        double bytes = minBytes * pow( 2., (double)k / (double)CACHE_STEPSPEROCTAVE );
+        if( bytes > maxBytes * 1.0001 )
+            break;
+        ws[n++] = bytes;
+    }
+    return n;
+}
+
+// find the working sets where the throughput curve falls off a plateau; bounds[k] is
+// the last working set on plateau k, so bounds[0] estimates L1, bounds[1] L2, and so on:
+static inline int
+DetectCacheBoundaries( const double *ws, const double *bw, int n, double *bounds, int maxBounds )
+{
+    if( n < 3 )
+        return 0;
+
+    // a 3-point median removes single noisy samples without moving the edges:
+    double smooth[CACHE_MAXPOINTS];
+    smooth[0] = bw[0];
+    smooth[n-1] = bw[n-1];
+    for( int i = 1; i < n-1; i++ )
+    {
+        double a = bw[i-1], b = bw[i], c = bw[i+1];
+        smooth[i] = a > b ? ( b > c ? b : ( a > c ? c : a ) ) : ( a > c ? a : ( b > c ? c : b ) );
+    }
+
+    int numBounds = 0;
+    double level = smooth[0];
+    for( int i = 1; i < n && numBounds < maxBounds; i++ )
+    {
+        int dropped = 1;
+        for( int j = i; j < i + CACHE_PERSIST && j < n; j++ )
+            if( smooth[j] >= ( 1. - CACHE_DROP ) * level )
+                dropped = 0;
+        if( !dropped )
+        {
+            if( smooth[i] > level )
+                level = smooth[i];
+            continue;
+        }
+
+        // the plateau ended at the previous point; ride the drop down to the next plateau:
+        bounds[numBounds++] = ws[i-1];
+        while( i+1 < n && smooth[i+1] < ( 1. - CACHE_SLOPE ) * smooth[i] )
+            i++;
+        level = smooth[i];
+    }
+    return numBounds;
+}
+
+// print the detected boundaries next to what /sys reports for each cache level:
+static inline void
+PrintCacheBoundaries( const double *bounds, int numBounds )
+{
+    for( int level = 1; level <= CACHE_MAXLEVELS; level++ )
+    {
+        size_t sysSize = CacheSize( level );
+        if( sysSize == 0 && level > numBounds )
+            break;
+        printf( "L%d cache: detected ", level );
+        if( level <= numBounds )
+            printf( "%10.0lf bytes", bounds[level-1] );
+        else
+            printf( "%16s", "-" );
+        if( sysSize > 0 )
+            printf( "   /sys %10zu bytes\n", sysSize );
+        else
+            printf( "   /sys %16s\n", "-" );
+    }
+    if( numBounds > 0 )
+        printf( "DRAM beyond %.0lf bytes\n", bounds[numBounds-1] );
+}
+
+// c[i] = a[i] * b[i] with non-temporal stores to c; the head is peeled until c is
+// vector-aligned, and the fence makes the streamed data visible before returning:
+static inline void
+StreamMul( const float *a, const float *b, float *c, size_t len )
+{
+#ifdef __AVX__
+    const size_t WIDTH = 8;
+#else
+    const size_t WIDTH = 4;
+#endif
+    size_t i = 0;
+    while( i < len && ( (uintptr_t)( c+i ) & ( WIDTH*sizeof(float) - 1 ) ) != 0 )
+    {
+        c[i] = a[i] * b[i];
+        i++;
+    }
+    for( ; i + WIDTH <= len; i += WIDTH )
+    {
+#ifdef __AVX__
+        _mm256_stream_ps( c+i, _mm256_mul_ps( _mm256_loadu_ps( a+i ), _mm256_loadu_ps( b+i ) ) );
+#else
+        _mm_stream_ps( c+i, _mm_mul_ps( _mm_loadu_ps( a+i ), _mm_loadu_ps( b+i ) ) );
+#endif
+    }
+    for( ; i < len; i++ )
+        c[i] = a[i] * b[i];
+    _mm_sfence( );
+}
+
+#endif
@@ -0,0 +1,207 @@
+/******************************************************************************
+** Program name: Shared benchmark helpers: NUMA placement and thread binding
+** Description: This header file reads the socket layout from /sys, binds the
+    threads of the current OpenMP team to cpus (compact or scatter), and splits
+    an array into the per-thread chunks used both for first-touch
+    initialization and for the timed kernels, so that every thread computes on
+    the pages it placed.
+    C files that include it must #define _GNU_SOURCE before any #include.
+******************************************************************************/
+
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+#include <omp.h>
+#include "Pages.h"
+
+#define PLACE_SERIAL        0       // main thread touches every page (the old behavior)
+#define PLACE_FIRSTTOUCH    1       // each thread touches the chunk it will compute on
+
+#define BIND_NONE           0       // let the OS schedule the threads
+#define BIND_COMPACT        1       // fill one socket before moving to the next
+#define BIND_SCATTER        2       // deal the threads round-robin across the sockets
+
+#define NUMA_MAXCPUS        1024
+
+static int NumaNumCpus = 0;
+static int NumaNumSockets = 1;
+static int NumaCpuList[NUMA_MAXCPUS];           // online cpus sorted by (socket, core, cpu)
+static int NumaCpuSocket[NUMA_MAXCPUS];         // socket of each cpu number
+static int ThreadSocket[NUMA_MAXCPUS];          // socket of each thread in the last bound team
+
+static inline int
+NumaReadInt( const char *path )
+{
+    FILE *fp = fopen( path, "r" );
+    if( fp == NULL )
+        return -1;
+    int value = -1;
+    if( fscanf( fp, "%d", &value ) != 1 )
+        value = -1;
+    fclose( fp );
+    return value;
+}
+
+// read the socket and core of every online cpu; falls back to one socket if /sys is missing:
+static inline void
+NumaInit( )
+{
+    if( NumaNumCpus > 0 )
+        return;
+
+    static int core[NUMA_MAXCPUS];
+    char path[128];
+    for( int cpu = 0; cpu < NUMA_MAXCPUS; cpu++ )
+    {
+        snprintf( path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu );
+        int socket = NumaReadInt( path );
+        if( socket < 0 )
+            continue;
+        snprintf( path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu );
+        NumaCpuSocket[cpu] = socket;
+        core[cpu] = NumaReadInt( path );
+        NumaCpuList[NumaNumCpus++] = cpu;
+        if( socket+1 > NumaNumSockets )
+            NumaNumSockets = socket+1;
+    }
+
+    if( NumaNumCpus == 0 )
+    {
+        NumaNumCpus = omp_get_num_procs( );
+        if( NumaNumCpus > NUMA_MAXCPUS )
+            NumaNumCpus = NUMA_MAXCPUS;
+        for( int cpu = 0; cpu < NumaNumCpus; cpu++ )
+        {
+            NumaCpuList[cpu] = cpu;
+            NumaCpuSocket[cpu] = 0;
+        }
+        return;
+    }
+
+    // insertion sort by (socket, core, cpu) so that hyperthread siblings end up last in compact order:
+    for( int i = 1; i < NumaNumCpus; i++ )
+    {
+        int cpu = NumaCpuList[i];
+        int j = i - 1;
+        while( j >= 0 && ( NumaCpuSocket[NumaCpuList[j]] > NumaCpuSocket[cpu] ||
+               ( NumaCpuSocket[NumaCpuList[j]] == NumaCpuSocket[cpu] && core[NumaCpuList[j]] > core[cpu] ) ) )
+        {
+            NumaCpuList[j+1] = NumaCpuList[j];
+            j--;
+        }
+        NumaCpuList[j+1] = cpu;
+    }
+}
+
+// the k-th cpu (mod the socket size) on a socket, in compact order:
+static inline int
+NumaCpuOnSocket( int socket, int k )
+{
+    int count = 0;
+    for( int i = 0; i < NumaNumCpus; i++ )
+        if( NumaCpuSocket[NumaCpuList[i]] == socket )
+            count++;
+    if( count == 0 )
+        return NumaCpuList[k % NumaNumCpus];
+
+    k %= count;
+    for( int i = 0; i < NumaNumCpus; i++ )
+    {
+        int cpu = NumaCpuList[i];
+        if( NumaCpuSocket[cpu] == socket && k-- == 0 )
+            return cpu;
+    }
+    return NumaCpuList[0];
+}
+
+// bind every thread of the next parallel region's team and record its socket in ThreadSocket[ ]:
+static inline void
+BindThreads( int mode )
+{
+    NumaInit( );
+
+    #pragma omp parallel
+    {
+        int me = omp_get_thread_num( );
+        int cpu = -1;
+        if( mode == BIND_COMPACT )
+            cpu = NumaCpuList[ me % NumaNumCpus ];
+        else if( mode == BIND_SCATTER )
+            cpu = NumaCpuOnSocket( me % NumaNumSockets, me / NumaNumSockets );
+
+        if( cpu >= 0 )
+        {
+            cpu_set_t set;
+            CPU_ZERO( &set );
+            CPU_SET( cpu, &set );
+            if( sched_setaffinity( 0, sizeof(set), &set ) != 0 )
+                cpu = -1;
+        }
+        if( cpu < 0 )
+            cpu = sched_getcpu( );              // unbound: wherever it happens to be running now
+
+        if( me < NUMA_MAXCPUS )
+            ThreadSocket[me] = ( cpu >= 0 && cpu < NUMA_MAXCPUS ) ? NumaCpuSocket[cpu] : 0;
+    }
+}
+
+// the same block partition as schedule(static), computed explicitly so init and compute agree:
+static inline void
+ChunkRange( size_t n, int me, int numThreads, size_t *lo, size_t *hi )
+{
+    size_t q = n / (size_t)numThreads;
+    size_t r = n % (size_t)numThreads;
+    size_t m = (size_t)me;
+    *lo = m*q + ( m < r ? m : r );
+    *hi = *lo + q + ( m < r ? 1 : 0 );
+}
+
+// the page kind PlaceAlloc( ) uses (PAGES_SMALL, PAGES_THP or PAGES_HUGETLB):
+static int PageMode = PAGES_SMALL;
+
+// fresh, untouched, page-aligned memory of the PageMode kind, so that the first write decides where each page lives:
+static inline void *
+PlaceAlloc( size_t bytes )
+{
+    return PageAlloc( bytes, PageMode );
+}
+
+static inline void
+PlaceFree( void *p, size_t bytes )
+{
+    PageFree( p, bytes, PageMode );
+}
+
+static inline int
+ParsePlacement( const char *s )
+{
+    if( strcmp( s, "serial" ) == 0 )      return PLACE_SERIAL;
+    if( strcmp( s, "firsttouch" ) == 0 )  return PLACE_FIRSTTOUCH;
+    return -1;
+}
+
+static inline int
+ParseBinding( const char *s )
+{
+    if( strcmp( s, "none" ) == 0 )        return BIND_NONE;
+    if( strcmp( s, "compact" ) == 0 )     return BIND_COMPACT;
+    if( strcmp( s, "scatter" ) == 0 )     return BIND_SCATTER;
+    return -1;
+}
+
+static inline const char *
+PlacementName( int mode )
+{
+    return mode == PLACE_FIRSTTOUCH ? "firsttouch" : "serial";
+}
+
+static inline const char *
+BindingName( int mode )
+{
+    return mode == BIND_COMPACT ? "compact" : mode == BIND_SCATTER ? "scatter" : "none";
+}
+
+#endif
@@ -0,0 +1,198 @@
+/******************************************************************************
+** Program name: Shared benchmark helpers: huge pages and dTLB counters
+** Description: This header file allocates the large benchmark arrays on
+    ordinary 4 KB pages, on transparent huge pages (madvise), or on explicit
+    2 MB pages from the hugetlbfs pool (MAP_HUGETLB), falling back to the next
+    kind when one is unavailable. It also counts dTLB misses on every thread
+    of the current OpenMP team with perf_event_open, so that the page kinds
+    can be compared on TLB behavior as well as on throughput.
+******************************************************************************/
+
+#ifndef PAGES_H
+#define PAGES_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <omp.h>
+
+#define PAGES_SMALL         0       // ordinary 4 KB pages (the old behavior)
+#define PAGES_THP           1       // transparent huge pages, requested with madvise
+#define PAGES_HUGETLB       2       // explicit huge pages from the reserved pool, else THP
+
+#define HUGEPAGE_BYTES      ( 2*1024*1024 )
+#define PAGES_MAXTHREADS    1024
+
+// how many allocations had to fall back to a smaller page kind:
+static int PageFallbacks = 0;
+
+// huge-page mappings are whole huge pages long; alloc and free must agree on the length:
+static inline size_t
+PageLength( size_t bytes, int mode )
+{
+    if( mode == PAGES_SMALL )
+        return bytes;
+    return ( bytes + HUGEPAGE_BYTES - 1 ) / HUGEPAGE_BYTES * HUGEPAGE_BYTES;
+}
+
+// 1 unless transparent huge pages are switched off entirely:
+static inline int
+PageTHPAvailable( )
+{
+    FILE *fp = fopen( "/sys/kernel/mm/transparent_hugepage/enabled", "r" );
+    if( fp == NULL )
+        return 0;
+    char line[128] = "";
+    if( fgets( line, sizeof(line), fp ) == NULL )
+        line[0] = '\0';
+    fclose( fp );
+    return strstr( line, "[never]" ) == NULL;
+}
+
+// fresh, untouched memory of the requested page kind; pages are still placed by their first write:
+static inline void *
+PageAlloc( size_t bytes, int mode )
+{
+    size_t len = PageLength( bytes, mode );
+
+    if( mode == PAGES_HUGETLB )
+    {
+        void *p = mmap( NULL, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0 );
+        if( p != MAP_FAILED )
+            return p;
+        PageFallbacks++;                    // pool empty or not configured: try THP instead
+        mode = PAGES_THP;
+    }
+
+    if( mode == PAGES_THP )
+    {
+        // over-map by one huge page and trim, so the region starts on a huge-page boundary:
+        char *raw = (char *)mmap( NULL, len + HUGEPAGE_BYTES, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0 );
+        if( raw == MAP_FAILED )
+            return NULL;
+        size_t head = ( HUGEPAGE_BYTES - (uintptr_t)raw % HUGEPAGE_BYTES ) % HUGEPAGE_BYTES;
+        if( head > 0 )
+            munmap( raw, head );
+        munmap( raw + head + len, HUGEPAGE_BYTES - head );
+        char *p = raw + head;
+        if( !PageTHPAvailable( ) || madvise( p, len, MADV_HUGEPAGE ) != 0 )
+            PageFallbacks++;                // still usable, just on small pages
+        return p;
+    }
+
+    void *p = mmap( NULL, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0 );
+    return p == MAP_FAILED ? NULL : p;
+}
+
+static inline void
+PageFree( void *p, size_t bytes, int mode )
+{
+    if( p != NULL )
+        munmap( p, PageLength( bytes, mode ) );
+}
+
+// bytes of this process currently backed by huge pages of either kind (0 if unknown):
+static inline size_t
+PagesHugeBytes( )
+{
+    FILE *fp = fopen( "/proc/self/smaps_rollup", "r" );
+    if( fp == NULL )
+        return 0;
+    size_t total = 0;
+    char line[256];
+    while( fgets( line, sizeof(line), fp ) != NULL )
+    {
+        size_t kb = 0;
+        if( sscanf( line, "AnonHugePages: %zu kB", &kb ) == 1 || sscanf( line, "Private_Hugetlb: %zu kB", &kb ) == 1 )
+            total += kb * 1024;
+    }
+    fclose( fp );
+    return total;
+}
+
+static inline int
+ParsePages( const char *s )
+{
+    if( strcmp( s, "small" ) == 0 )       return PAGES_SMALL;
+    if( strcmp( s, "thp" ) == 0 )         return PAGES_THP;
+    if( strcmp( s, "hugetlb" ) == 0 )     return PAGES_HUGETLB;
+    return -1;
+}
+
+static inline const char *
+PagesName( int mode )
+{
+    return mode == PAGES_THP ? "thp" : mode == PAGES_HUGETLB ? "hugetlb" : "small";
+}
+
+// dTLB load and store miss counters of each thread in the team that last called TlbOpen( ):
+static int TlbFd[PAGES_MAXTHREADS][2];
+static int TlbNumThreads = 0;
+
+static inline int
+TlbOpenCounter( int op )
+{
+    struct perf_event_attr attr;
+    memset( &attr, 0, sizeof(attr) );
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | ( op << 8 ) | ( PERF_COUNT_HW_CACHE_RESULT_MISS << 16 );
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall( SYS_perf_event_open, &attr, 0, -1, -1, 0 );
+}
+
+// start counting on every thread of the next parallel region's team (the threads persist between regions):
+static inline void
+TlbOpen( )
+{
+    #pragma omp parallel
+    {
+        int me = omp_get_thread_num( );
+        if( me < PAGES_MAXTHREADS )
+        {
+            TlbFd[me][0] = TlbOpenCounter( PERF_COUNT_HW_CACHE_OP_READ );
+            TlbFd[me][1] = TlbOpenCounter( PERF_COUNT_HW_CACHE_OP_WRITE );
+        }
+        #pragma omp single
+        TlbNumThreads = omp_get_num_threads( ) < PAGES_MAXTHREADS ? omp_get_num_threads( ) : PAGES_MAXTHREADS;
+    }
+}
+
+// dTLB misses counted so far over all threads, or -1 if the counters are unavailable
+// (no PMU in a VM, or perf_event_paranoid too strict):
+static inline long long
+TlbRead( )
+{
+    long long total = 0;
+    int counted = 0;
+    for( int t = 0; t < TlbNumThreads; t++ )
+    {
+        for( int c = 0; c < 2; c++ )
+        {
+            long long value;
+            if( TlbFd[t][c] >= 0 && read( TlbFd[t][c], &value, sizeof(value) ) == (ssize_t)sizeof(value) )
+            {
+                total += value;
+                counted = 1;
+            }
+        }
+    }
+    return counted ? total : -1;
+}
+
+static inline void
+TlbClose( )
+{
+    for( int t = 0; t < TlbNumThreads; t++ )
+        for( int c = 0; c < 2; c++ )
+            if( TlbFd[t][c] >= 0 )
+                close( TlbFd[t][c] );
+    TlbNumThreads = 0;
+}
+
+#endif
@@ -14,6 +14,8 @@
 #include "CL/cl.h"
 #include "CL/cl_platform.h"
 
+#include "../../../Common/Bench.h"
+
 #define SIXTY_FOUR		64
 
 #ifndef GLOBAL_WORK_SIZE
@@ -35,6 +37,16 @@ const float			TOL = 0.0001f;
 
 void				Wait( cl_command_queue );
 int				LookAtTheBits( float );
+void				RunKernel( void * );
+
+// one kernel launch (enqueue and wait), handed to the benchmark engine:
+struct KernelRun
+{
+	cl_command_queue	cmdQueue;
+	cl_kernel		kernel;
+	size_t			*globalWorkSize;
+	size_t			*localWorkSize;
+};
 
 
 int
@@ -198,14 +210,13 @@ main( int argc, char *argv[ ] )
 	size_t localWorkSize[3]  = { LOCAL_SIZE,   1, 1 };
 
 	Wait( cmdQueue );
-	double time0 = omp_get_wtime( );
 
-	status = clEnqueueNDRangeKernel( cmdQueue, kernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL );
-	if( status != CL_SUCCESS )
-		fprintf( stderr, "clEnqueueNDRangeKernel failed: %d\n", status );
+	// time the launches with the benchmark engine (the warm-ups absorb the first-launch cost):
 
-	Wait( cmdQueue );
-	double time1 = omp_get_wtime( );
+	struct BenchConfig config = BENCH_DEFAULTS;
+	struct BenchStats stats;
+	struct KernelRun run = { cmdQueue, kernel, globalWorkSize, localWorkSize };
+	BenchRun( &config, RunKernel, &run, &stats );
 
 	// 12. read the results buffer back from the device to the host:
 
@@ -222,7 +233,8 @@ main( int argc, char *argv[ ] )
 	}
 
 	fprintf( stderr, "%8d\t%4d\t%10d\t%10.3lf MegaMultiply-ReductionsPerSecond\n",
-		NUM_ELEMENTS, LOCAL_SIZE, NUM_WORK_GROUPS, (double)NUM_ELEMENTS/(time1-time0)/1000000. );
+		NUM_ELEMENTS, LOCAL_SIZE, NUM_WORK_GROUPS, (double)NUM_ELEMENTS/stats.median/1000000. );
+	BenchPrint( &stats, (double)NUM_ELEMENTS, "MultReductions" );
 
 #ifdef WIN32
 	Sleep( 2000 );
@@ -246,6 +258,21 @@ main( int argc, char *argv[ ] )
 }
 
 
+// enqueue the kernel once and wait for it to finish:
+
+void
+RunKernel( void *arg )
+{
+	KernelRun *run = (KernelRun *)arg;
+
+	cl_int status = clEnqueueNDRangeKernel( run->cmdQueue, run->kernel, 1, NULL, run->globalWorkSize, run->localWorkSize, 0, NULL, NULL );
+	if( status != CL_SUCCESS )
+		fprintf( stderr, "clEnqueueNDRangeKernel failed: %d\n", status );
+
+	Wait( run->cmdQueue );
+}
+
+
 // wait until all queued tasks have completed:
 
 void
@@ -14,6 +14,9 @@
 #include "helper_functions.h"
 #include "helper_cuda.h"
 
+// the intersection math, shared with the OpenMP version:
+#include "../../../Project1/Bounce.hpp"
+
 
 #ifndef BLOCKSIZE					// 16, 32, and 64
 #define BLOCKSIZE		16			// number of threads per block 
@@ -31,6 +34,18 @@
 #define TOLERANCE		0.00001f	// tolerance to relative error
 #endif
 
+#ifndef STORE						// float or double
+#define STORE			float		// type the circles are stored and copied in
+#endif
+
+#ifndef CALC						// float or double
+#define CALC			float		// type the intersection math is done in
+#endif
+
+// define FASTNEWTON (0, 1, 2) to run the float fast path instead: rsqrtf and
+// __fdividef estimates in place of the square roots and divisions, each
+// sharpened by FASTNEWTON Newton steps
+
 // ranges for the random numbers:
 const float XCMIN = 0.0;
 const float XCMAX = 2.0;
@@ -47,7 +62,7 @@ void		TimeOfDaySeed();
 
 // Monte Carlo simulation (CUDA Kernel) on the device
 
-__global__  void MonteCarlo( float *xcs, float *ycs, float *rs, int *hits )
+__global__  void MonteCarlo( STORE *xcs, STORE *ycs, STORE *rs, int *hits )
 {
 	// get thread info
 	unsigned int numItems = blockDim.x;
@@ -59,76 +74,14 @@ __global__  void MonteCarlo( float *xcs, float *ycs, float *rs, int *hits )
 	__shared__ float numHits[BLOCKSIZE];
 	numHits[tnum] = 0;					
 
-	// randomize the location and radius of the circle:
-	float xc = xcs[gid];
-	float yc = ycs[gid];
-	float  r = rs[gid];
-
-	// solve for the intersection using the quadratic formula:
-	float a = 2.;
-	float b = -2. * (xc + yc);
-	float c = xc * xc + yc * yc - r * r;
-	float d = b * b - 4. * a * c;
-
-	// case A: circle completely missed (d < 0.)
-	if (d < 0.)
-	{
-		numHits[tnum] = 0;
-		goto finish_analysis;
-	}
-		
-	// if not case A, hits the circle:
-	// get the first intersection:
-	d = sqrtf(d);
-	float t1 = (-b + d) / (2. * a);						 // time to intersect the circle
-	float t2 = (-b - d) / (2. * a);						 // time to intersect the circle
-	float tmin = t1 < t2 ? t1 : t2;					     // only care about the first intersection
-
-	// case B: circle engulfs line (tmin < 0.)
-	if (tmin < 0.)
-	{
-		numHits[tnum] = 0;
-		goto finish_analysis;
-	}
-		
-	// if not case A or case B, where does it intersect the circle?
-	float xcir = tmin;
-	float ycir = tmin;
-
-	// get the unitized normal vector at the point of intersection:
-	float nx = xcir - xc;
-	float ny = ycir - yc;
-	float n = sqrtf(nx * nx + ny * ny);
-	nx /= n;											// unit vector
-	ny /= n;											// unit vector
-							
-	// get the unitized incoming vector:
-	float inx = xcir - 0.;
-	float iny = ycir - 0.;
-	float in = sqrtf(inx * inx + iny * iny);
-	inx /= in;											// unit vector
-	iny /= in;											// unit vector
-
-	// get the outgoing (bounced) vector:
-	float dot = inx * nx + iny * ny;
-	float outx = inx - 2. * nx * dot;					// angle of reflection = angle of incidence`
-	float outy = iny - 2. * ny * dot;					// angle of reflection = angle of incidence`
-
-	// find out if it hits the infinite plate:
-	float t = (0. - ycir) / outy;
-
-	// case C: line bounced back up (t < 0.)
-	if (t < 0.)
-	{
-		numHits[tnum] = 0;
-		goto finish_analysis;
-	}
-
-	// case D: if not case A, B, or C, line hit the plate
-	numHits[tnum] = 1;
+	// one trial, in the precision picked with STORE and CALC or on the fast path:
+#ifdef FASTNEWTON
+	numHits[tnum] = BounceFast<FASTNEWTON>( (float)xcs[gid], (float)ycs[gid], (float)rs[gid] );
+#else
+	numHits[tnum] = Bounce<STORE, CALC>( xcs[gid], ycs[gid], rs[gid] );
+#endif
 
 	// do the reduction (all threads execute simultaneously)
-	finish_analysis:									
 	for (int offset = 1; offset < numItems; offset *= 2)
 	{
 		int mask = 2 * offset - 1;
@@ -157,9 +110,9 @@ main( int argc, char* argv[ ] )
 
 	// allocate host memory:
 
-	float *hXCS    = new float[ SIZE ];			// x centers
-	float *hYCS    = new float[ SIZE ];			// y centers
-	float *hRS     = new float[ SIZE ];			// radius
+	STORE *hXCS    = new STORE[ SIZE ];			// x centers
+	STORE *hYCS    = new STORE[ SIZE ];			// y centers
+	STORE *hRS     = new STORE[ SIZE ];			// radius
 	int   *hHits   = new int  [ SIZE ];			// return results from work groups to add on CPU
 
 	for (int n = 0; n < SIZE; n++)
@@ -172,7 +125,7 @@ main( int argc, char* argv[ ] )
 
 	// allocate device memory:
 
-	float *dXCS, *dYCS, *dRS;
+	STORE *dXCS, *dYCS, *dRS;
 	int   *dHits;
 
 	dim3 dimsXCS(SIZE, 1, 1);
@@ -183,11 +136,11 @@ main( int argc, char* argv[ ] )
 	//__shared__ float prods[SIZE/BLOCKSIZE];
 
 	cudaError_t status;			
-	status = cudaMalloc(reinterpret_cast<void **>(&dXCS), SIZE * sizeof(float));
+	status = cudaMalloc(reinterpret_cast<void **>(&dXCS), SIZE * sizeof(STORE));
 		checkCudaErrors(status);
-	status = cudaMalloc(reinterpret_cast<void **>(&dYCS), SIZE * sizeof(float));
+	status = cudaMalloc(reinterpret_cast<void **>(&dYCS), SIZE * sizeof(STORE));
 		checkCudaErrors(status);
-	status = cudaMalloc(reinterpret_cast<void **>(&dRS),  SIZE * sizeof(float));
+	status = cudaMalloc(reinterpret_cast<void **>(&dRS),  SIZE * sizeof(STORE));
 		checkCudaErrors(status);
 	status = cudaMalloc(reinterpret_cast<void **>(&dHits), (SIZE / BLOCKSIZE) * sizeof(int));
 		checkCudaErrors(status);
@@ -195,11 +148,11 @@ main( int argc, char* argv[ ] )
 
 	// copy host memory to the device:
 
-	status = cudaMemcpy(dXCS, hXCS, SIZE * sizeof(float), cudaMemcpyHostToDevice);
+	status = cudaMemcpy(dXCS, hXCS, SIZE * sizeof(STORE), cudaMemcpyHostToDevice);
 		checkCudaErrors(status);
-	status = cudaMemcpy(dYCS, hYCS, SIZE * sizeof(float), cudaMemcpyHostToDevice);
+	status = cudaMemcpy(dYCS, hYCS, SIZE * sizeof(STORE), cudaMemcpyHostToDevice);
 		checkCudaErrors(status);
-	status = cudaMemcpy(dRS,  hRS,  SIZE * sizeof(float), cudaMemcpyHostToDevice);
+	status = cudaMemcpy(dRS,  hRS,  SIZE * sizeof(STORE), cudaMemcpyHostToDevice);
 		checkCudaErrors(status);
 
 	// setup the execution parameters:
@@ -267,6 +220,27 @@ main( int argc, char* argv[ ] )
 	float probability = (totalHits / SIZE) * 100;
 	printf("Probability: %10.2lf\n", probability);
 
+	// check the kernel's precision against the same trials done in double on the host
+	// (with FASTNEWTON, the host's fast path, whose estimates are the CPU's, not the GPU's):
+
+	int refHits = 0;
+	int mismatches = 0;
+	for (int n = 0; n < SIZE; n++)
+	{
+		int ref = Bounce<double, double>( (double)hXCS[n], (double)hYCS[n], (double)hRS[n] );
+		refHits += ref;
+#ifdef FASTNEWTON
+		mismatches += ref != BounceFast<FASTNEWTON>( (float)hXCS[n], (float)hYCS[n], (float)hRS[n] );
+#else
+		mismatches += ref != Bounce<STORE, CALC>( hXCS[n], hYCS[n], hRS[n] );
+#endif
+	}
+	printf("Precision: %s storage, %s math\n", sizeof(STORE) == sizeof(float) ? "float" : "double", sizeof(CALC) == sizeof(float) ? "float" : "double");
+#ifdef FASTNEWTON
+	printf("Fast path: rsqrt/rcp estimates + %d Newton step(s) on the device (the probability above)\n", FASTNEWTON);
+#endif
+	printf("Double reference probability: %10.2lf\nMismatched trials (host): %d\n", (float)refHits / SIZE * 100, mismatches);
+
 	// read performance and probability to file
 
 	FILE* outputResults = fopen("monteCarlo_results.csv", "a");
@@ -1,62 +1,566 @@
+#define _GNU_SOURCE                     // for the cpu affinity calls in Numa.h
 #include <omp.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include "../Common/Numa.h"
+#include "../Common/Bench.h"
+#include "../Common/Cache.h"
 
-//#define NUMT        4                //defined in shell script
-//#define ARRAYSIZE   500000
-#define NUMTRIES    1000
+// usage:  ./proj0 [-t threads,threads,...] [-p serial|firsttouch] [-b none|compact|scatter]
+//                 [-H small|thp|hugetlb] [arraysize ...]
+//         ./proj0 -d [-m maxbytes] [-t threads] [-p ...] [-b ...] [-H ...]
+//      array sizes are in elements and accept a K, M or G suffix (powers of 2);
+//      with no sizes on the command line, the DEFAULTSIZES ladder is run;
+//      with no -t list, the thread counts are NUMT if it was defined when
+//      compiling, otherwise 1, 2, 4, ... up to the number of processors;
+//      -p firsttouch re-allocates the arrays for every run and initializes them
+//      with the same per-thread chunks the kernels use, so each page lands on
+//      the socket of the thread that computes on it; -b pins the threads;
+//      -H backs the arrays with 4 KB pages, transparent huge pages, or the
+//      hugetlbfs pool (falling back to THP, then 4 KB), and the dTLB misses per
+//      thousand elements are reported next to the throughput when the PMU allows;
+//      each run is timed by the engine in Bench.h (see the BENCH_* macros);
+//      mult-nt is the multiply with streaming stores, and mult-auto uses them only
+//      when the three arrays together exceed the last-level cache of every socket;
+//      -d discovers the cache hierarchy instead: it sweeps the multiply's working set
+//      from 4K to -m bytes (default DISCOVERMAX) on one thread unless -t says otherwise,
+//      and prints the plateau boundaries it finds next to the /sys cache sizes
 
-float A[ARRAYSIZE];
-float B[ARRAYSIZE];
-float C[ARRAYSIZE];
+#define MAXSIZES    64
+#define MAXTHREADS  64
+#define SCALAR      3.0f
+#define DISCOVERMAX (1024.*1024.*1024.)
+#define DISCOVERMIN 4096.
 
-int main()
+// each discovery point repeats the kernel until about this many elements have been done:
+#define DISCOVERWORK    (1<<24)
+
+// and is sampled for at most this many seconds:
+#define DISCOVERSECONDS 0.5
+
+// the arrays are sized at run time to the largest requested size:
+float *A;
+float *B;
+float *C;
+
+// per-thread compute time, summed over ThreadCalls runs, for the per-socket bandwidth:
+double ThreadTime[NUMA_MAXCPUS];
+int    ThreadCalls;
+
+// set per array size: do the arrays overflow the last-level cache(s)?
+int UseStreamingStores;
+
+const size_t DEFAULTSIZES[] = { 1<<16, 1<<18, 1<<20, 1<<22, 1<<24 };
+
+// the STREAM kernels plus the original multiply, each over one thread's chunk [lo,hi):
+void Copy( size_t lo, size_t hi )
+{
+    for (size_t i = lo; i < hi; i++)
+    {
+        C[i] = A[i];
+    }
+}
+
+void Scale( size_t lo, size_t hi )
+{
+    for (size_t i = lo; i < hi; i++)
+    {
+        B[i] = SCALAR * C[i];
+    }
+}
+
+void Add( size_t lo, size_t hi )
+{
+    for (size_t i = lo; i < hi; i++)
+    {
+        C[i] = A[i] + B[i];
+    }
+}
+
+void Triad( size_t lo, size_t hi )
+{
+    for (size_t i = lo; i < hi; i++)
+    {
+        A[i] = B[i] + SCALAR * C[i];
+    }
+}
+
+void Mult( size_t lo, size_t hi )
+{
+    for (size_t i = lo; i < hi; i++)
+    {
+        C[i] = A[i] * B[i];
+    }
+}
+
+// the multiply without the read-for-ownership of C:
+void MultStream( size_t lo, size_t hi )
+{
+    StreamMul(A+lo, B+lo, C+lo, hi-lo);
+}
+
+// the multiply the benchmark would pick for this array size:
+void MultAuto( size_t lo, size_t hi )
+{
+    if (UseStreamingStores)
+        MultStream(lo, hi);
+    else
+        Mult(lo, hi);
+}
+
+// bytes are counted the STREAM way (every array read or written once per element),
+// ops are floating-point operations per element (copy counts its one move):
+struct Kernel
+{
+    const char *name;
+    int         bytesPerElem;
+    int         opsPerElem;
+    void      (*func)( size_t, size_t );
+};
+
+const struct Kernel KERNELS[] =
+{
+    { "copy",      2*sizeof(float), 1, Copy  },
+    { "scale",     2*sizeof(float), 1, Scale },
+    { "add",       3*sizeof(float), 1, Add   },
+    { "triad",     3*sizeof(float), 2, Triad },
+    { "mult",      3*sizeof(float), 1, Mult  },
+    { "mult-nt",   3*sizeof(float), 1, MultStream },
+    { "mult-auto", 3*sizeof(float), 1, MultAuto   },
+};
+#define NUMKERNELS  (int)( sizeof(KERNELS) / sizeof(KERNELS[0]) )
+
+// mult-auto is printed with the path it picked:
+const char *KernelName( int k )
+{
+    if (KERNELS[k].func == MultAuto)
+        return UseStreamingStores ? "mult-auto:nt" : "mult-auto:plain";
+    return KERNELS[k].name;
+}
+
+// one kernel over n elements on the current team, as a BenchFunc; reps > 1 repeats
+// it inside the same parallel region so tiny working sets are not swamped by fork/join:
+struct KernelRun
+{
+    int     k;
+    size_t  n;
+    int     reps;
+};
+
+void RunKernel( void *arg )
+{
+    const struct KernelRun *run = (const struct KernelRun *)arg;
+
+    #pragma omp parallel
+    {
+        int me = omp_get_thread_num();
+        size_t lo, hi;
+        ChunkRange(run->n, me, omp_get_num_threads(), &lo, &hi);
+
+        double t0 = omp_get_wtime();
+        for (int r = 0; r < run->reps; r++)
+            KERNELS[run->k].func(lo, hi);
+        ThreadTime[me] += omp_get_wtime() - t0;
+    }
+    ThreadCalls++;
+}
+
+// fill the arrays, either from the main thread or from the threads that will compute on them:
+void InitArrays( size_t n, int placement )
+{
+    if (placement == PLACE_FIRSTTOUCH)
+    {
+        #pragma omp parallel
+        {
+            size_t lo, hi;
+            ChunkRange(n, omp_get_thread_num(), omp_get_num_threads(), &lo, &hi);
+            for (size_t i = lo; i < hi; i++)
+            {
+                A[i] = 1.f;
+                B[i] = 2.f;
+                C[i] = 0.f;
+            }
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            A[i] = 1.f;
+            B[i] = 2.f;
+            C[i] = 0.f;
+        }
+    }
+}
+
+void FreeArrays( size_t n )
+{
+    PlaceFree(A, n * sizeof(float));
+    PlaceFree(B, n * sizeof(float));
+    PlaceFree(C, n * sizeof(float));
+    A = B = C = NULL;
+}
+
+int AllocArrays( size_t n )
+{
+    A = (float *)PlaceAlloc(n * sizeof(float));
+    B = (float *)PlaceAlloc(n * sizeof(float));
+    C = (float *)PlaceAlloc(n * sizeof(float));
+    if (A == NULL || B == NULL || C == NULL)
+    {
+        // give back whichever ones did succeed:
+        FreeArrays(n);
+        return 0;
+    }
+    return 1;
+}
+
+// sweep the multiply's working set on a log scale and find the cache plateaus:
+int Discover( double maxBytes, int placement )
+{
+    double ws[CACHE_MAXPOINTS];
+    double bw[CACHE_MAXPOINTS];
+    int numPoints = CacheSweepSizes(DISCOVERMIN, maxBytes, ws);
+
+    int k = 0;
+    while (KERNELS[k].func != Mult)
+        k++;
+
+    size_t maxN = (size_t)(ws[numPoints-1] / (double)KERNELS[k].bytesPerElem) + 1;
+    if (!AllocArrays(maxN))
+    {
+        fprintf(stderr, "Cannot allocate 3 arrays of %zu elements\n", maxN);
+        return 1;
+    }
+    InitArrays(maxN, placement);
+
+    // many points, so each one gets a short time budget; the median is what gets compared:
+    struct BenchConfig config = BENCH_DEFAULTS;
+    config.maxSeconds = DISCOVERSECONDS;
+    printf("Working set bytes\tElements\tReps\tMedian GB/s\tCI +-%%\n");
+    for (int i = 0; i < numPoints; i++)
+    {
+        size_t n = (size_t)(ws[i] / (double)KERNELS[k].bytesPerElem);
+        int reps = n < DISCOVERWORK ? (int)(DISCOVERWORK / n) : 1;
+
+        struct KernelRun run = { k, n, reps };
+        struct BenchStats stats;
+        BenchRun(&config, RunKernel, &run, &stats);
+
+        ws[i] = (double)n * (double)KERNELS[k].bytesPerElem;
+        bw[i] = ws[i] * (double)reps / stats.median / 1.e9;
+        printf("%.0lf\t%zu\t%d\t%8.2lf\t%6.2lf\n", ws[i], n, reps, bw[i], BenchCIPercent(&stats));
+    }
+
+    double bounds[CACHE_MAXLEVELS];
+    int numBounds = DetectCacheBoundaries(ws, bw, numPoints, bounds, CACHE_MAXLEVELS);
+    PrintCacheBoundaries(bounds, numBounds);
+
+    FreeArrays(maxN);
+    return 0;
+}
+
+// parse an element count such as 500000, 64K or 16M:
+size_t ParseSize( const char *s )
+{
+    char *end;
+    double value = strtod(s, &end);
+    if (end == s || !(value > 0.))
+        return 0;
+    switch (*end)
+    {
+        case 'k': case 'K': value *= 1024.;             end++;  break;
+        case 'm': case 'M': value *= 1024.*1024.;       end++;  break;
+        case 'g': case 'G': value *= 1024.*1024.*1024.; end++;  break;
+    }
+    // the whole argument must be the size, and it must fit a size_t:
+    if (*end != '\0' || value >= 18446744073709551615.)
+        return 0;
+    return (size_t)value;
+}
+
+// parse a comma-separated thread list such as 1,2,4,8:
+int ParseThreads( const char *s, int *threads, int maxThreads )
+{
+    int num = 0;
+    while (*s != '\0' && num < maxThreads)
+    {
+        char *end;
+        long t = strtol(s, &end, 10);
+        if (end == s || t < 1 || t > NUMA_MAXCPUS)
+            return 0;
+        threads[num++] = (int)t;
+        s = (*end == ',') ? end+1 : end;
+    }
+    return num;
+}
+
+// Amdahl parallel fraction from one speedup measurement on p threads:
+//      S = 1 / ( (1-F) + F/p )   =>   F = (1 - 1/S) / (1 - 1/p)
+double ParallelFraction( double speedup, int p )
+{
+    if (p <= 1)
+        return 0.;
+    return (1. - 1./speedup) / (1. - 1./(double)p);
+}
+
+int main( int argc, char *argv[] )
 {
 #ifndef _OPENMP
     fprintf(stderr, "OpenMP is not supported here -- sorry.\n");
     return 1;
 #endif
 
-omp_set_num_threads(NUMT);
-    fprintf(stderr, "Using %d thread(s)\n", NUMT);
+    // thread counts and array sizes come from the command line instead of the shell script:
+    int threads[MAXTHREADS];
+    int numThreads = 0;
+    size_t sizes[MAXSIZES];
+    int numSizes = 0;
+    int placement = PLACE_SERIAL;
+    int binding = BIND_NONE;
+    int pages = PAGES_SMALL;
+    int discover = 0;
+    double discoverMax = DISCOVERMAX;
+    for (int a = 1; a < argc && numSizes < MAXSIZES; a++)
+    {
+        if (strcmp(argv[a], "-t") == 0 && a+1 < argc)
+        {
+            numThreads = ParseThreads(argv[++a], threads, MAXTHREADS);
+            if (numThreads == 0)
+            {
+                fprintf(stderr, "Bad thread list '%s'\n", argv[a]);
+                return 1;
+            }
+            continue;
+        }
+        if (strcmp(argv[a], "-p") == 0 && a+1 < argc)
+        {
+            placement = ParsePlacement(argv[++a]);
+            if (placement < 0)
+            {
+                fprintf(stderr, "Bad placement '%s' (serial or firsttouch)\n", argv[a]);
+                return 1;
+            }
+            continue;
+        }
+        if (strcmp(argv[a], "-b") == 0 && a+1 < argc)
+        {
+            binding = ParseBinding(argv[++a]);
+            if (binding < 0)
+            {
+                fprintf(stderr, "Bad binding '%s' (none, compact or scatter)\n", argv[a]);
+                return 1;
+            }
+            continue;
+        }
+        if (strcmp(argv[a], "-H") == 0 && a+1 < argc)
+        {
+            pages = ParsePages(argv[++a]);
+            if (pages < 0)
+            {
+                fprintf(stderr, "Bad page kind '%s' (small, thp or hugetlb)\n", argv[a]);
+                return 1;
+            }
+            continue;
+        }
+        if (strcmp(argv[a], "-d") == 0)
+        {
+            discover = 1;
+            continue;
+        }
+        if (strcmp(argv[a], "-m") == 0 && a+1 < argc)
+        {
+            discoverMax = (double)ParseSize(argv[++a]);
+            if (discoverMax < DISCOVERMIN)
+            {
+                fprintf(stderr, "Bad discovery limit '%s'\n", argv[a]);
+                return 1;
+            }
+            continue;
+        }
+        sizes[numSizes] = ParseSize(argv[a]);
+        if (sizes[numSizes] == 0)
+        {
+            fprintf(stderr, "Bad array size '%s'\n", argv[a]);
+            return 1;
+        }
+        numSizes++;
+    }
+    if (numSizes == 0)
+    {
+        for (size_t s = 0; s < sizeof(DEFAULTSIZES)/sizeof(DEFAULTSIZES[0]); s++)
+            sizes[numSizes++] = DEFAULTSIZES[s];
+    }
+    if (numThreads == 0 && discover)
+    {
+        threads[numThreads++] = 1;
+    }
+    if (numThreads == 0)
+    {
+#ifdef NUMT
+        threads[numThreads++] = NUMT;
+#else
+        int numProcs = omp_get_num_procs();
+        for (int t = 1; t < numProcs && numThreads < MAXTHREADS-1; t *= 2)
+            threads[numThreads++] = t;
+        threads[numThreads++] = numProcs;
+#endif
+    }
 
-    double maxMegaMults = 0.;
-    double sumMegaMults = 0.;
-    double minTimeDiff = 999999;
-    double sumTimeDiff = 0.;
+    // every array allocation below goes through PlaceAlloc with this page kind:
+    PageMode = pages;
 
-    for (int t = 0; t < NUMTRIES; t++)
+    // cache discovery runs on the first thread count only:
+    if (discover)
     {
-        double time0 = omp_get_wtime();
-        //printf("Time 0     = %lf seconds\n", time0);
+        omp_set_num_threads(threads[0]);
+        BindThreads(binding);
+        return Discover(discoverMax, placement);
+    }
 
-        #pragma omp parallel for
-        for (int i = 0; i < ARRAYSIZE; i++)
-        {
-            C[i] = A[i] * B[i];
-        }
+    size_t maxSize = 0;
+    for (int s = 0; s < numSizes; s++)
+    {
+        if (sizes[s] > maxSize)
+            maxSize = sizes[s];
+    }
 
-        double time1 = omp_get_wtime();
-        //printf("Time 1     = %lf seconds\n", time1);
-        double timeDiff = (time1-time0)*100000.;
-        sumTimeDiff += timeDiff; 
-        if (timeDiff < minTimeDiff)
+    // serial placement allocates and fills once; first-touch re-places for every run below:
+    if (placement == PLACE_SERIAL)
+    {
+        if (!AllocArrays(maxSize))
         {
-            minTimeDiff = timeDiff;
+            fprintf(stderr, "Cannot allocate 3 arrays of %zu elements\n", maxSize);
+            return 1;
         }
-        
-        double megaMults = (double)ARRAYSIZE/(time1-time0)/1000000.;
-        sumMegaMults += megaMults;
-        if (megaMults > maxMegaMults)
+        InitArrays(maxSize, PLACE_SERIAL);
+    }
+
+    NumaInit();
+    fprintf(stderr, "Placement %s, binding %s, %s pages, %d socket(s)\n",
+        PlacementName(placement), BindingName(binding), PagesName(pages), NumaNumSockets);
+    if (placement == PLACE_SERIAL)
+        fprintf(stderr, "Huge pages back %zu bytes (%d allocation(s) fell back to smaller pages)\n",
+            PagesHugeBytes(), PageFallbacks);
+
+    // streaming stores pay off once the working set cannot stay in any last-level cache:
+    size_t streamThreshold = LastLevelCacheSize() * (size_t)NumaNumSockets;
+    fprintf(stderr, "Streaming stores above %zu bytes of arrays\n", streamThreshold);
+
+    // print one tab-separated line per (size, kernel, threads) so it pastes into Excel;
+    // rates use the median time, and speedup and efficiency are relative to one thread
+    // (put 1 first in the -t list):
+    struct BenchConfig config = BENCH_DEFAULTS;
+    printf("Elements\tKernel\tThreads\tMedian GB/s\tPeak GB/s\tMedian MegaOps/Sec\tMedian usec\tp5 usec\tp95 usec\tp99 usec\tCI +-%%\tRuns\tKept\tSpeedup\tEfficiency\tParallel fraction\tdTLB misses/Kelem");
+    for (int sk = 0; sk < NumaNumSockets; sk++)
+        printf("\tSocket%d GB/s", sk);
+    printf("\n");
+
+    for (int s = 0; s < numSizes; s++)
+    {
+        size_t n = sizes[s];
+        UseStreamingStores = streamThreshold > 0 && 3*n*sizeof(float) > streamThreshold;
+        for (int k = 0; k < NUMKERNELS; k++)
         {
-            maxMegaMults = megaMults;
+            double baseTime = 0.;
+            double sumFitXY = 0., sumFitXX = 0.;
+
+            for (int p = 0; p < numThreads; p++)
+            {
+                omp_set_num_threads(threads[p]);
+                BindThreads(binding);
+
+                if (placement == PLACE_FIRSTTOUCH)
+                {
+                    if (!AllocArrays(n))
+                    {
+                        fprintf(stderr, "Cannot allocate 3 arrays of %zu elements\n", n);
+                        return 1;
+                    }
+                    InitArrays(n, PLACE_FIRSTTOUCH);
+                }
+
+                for (int i = 0; i < threads[p]; i++)
+                    ThreadTime[i] = 0.;
+                ThreadCalls = 0;
+
+                TlbOpen();
+                long long tlb0 = TlbRead();
+                struct KernelRun run = { k, n, 1 };
+                struct BenchStats stats;
+                BenchRun(&config, RunKernel, &run, &stats);
+                long long tlb1 = TlbRead();
+                TlbClose();
+
+                // if the list does not start at 1, assume perfect scaling up to its first entry:
+                if (p == 0)
+                    baseTime = stats.median * (double)threads[0];
+                double speedup = baseTime / stats.median;
+                double efficiency = speedup / (double)threads[p];
+
+                // least-squares fit of Tp/T1 - 1 = F * (1/p - 1) over all thread counts:
+                double x = 1./(double)threads[p] - 1.;
+                double y = stats.median / baseTime - 1.;
+                sumFitXY += x*y;
+                sumFitXX += x*x;
+
+                double bytes = (double)n * (double)KERNELS[k].bytesPerElem;
+                double ops   = (double)n * (double)KERNELS[k].opsPerElem;
+
+                printf("%zu\t%s\t%d\t%8.2lf\t%8.2lf\t%8.2lf\t%8.2lf\t%8.2lf\t%8.2lf\t%8.2lf\t%6.2lf\t%d\t%d\t%6.2lf\t%6.2lf\t%6.3lf",
+                    n, KernelName(k), threads[p],
+                    bytes / stats.median / 1.e9,
+                    bytes / stats.min / 1.e9,
+                    ops / stats.median / 1.e6,
+                    stats.median * 1.e6,
+                    stats.p5 * 1.e6,
+                    stats.p95 * 1.e6,
+                    stats.p99 * 1.e6,
+                    BenchCIPercent(&stats),
+                    stats.runs, stats.kept,
+                    speedup, efficiency,
+                    ParallelFraction(speedup, threads[p]));
+                if (tlb0 >= 0 && tlb1 >= 0)
+                    printf("\t%8.3lf", (double)(tlb1 - tlb0) / (double)ThreadCalls / ((double)n / 1000.));
+                else
+                    printf("\t-");
+
+                // each socket moves its threads' chunks in the time of its slowest thread:
+                for (int sk = 0; sk < NumaNumSockets; sk++)
+                {
+                    double socketBytes = 0.;
+                    double socketTime = 0.;
+                    for (int i = 0; i < threads[p]; i++)
+                    {
+                        if (ThreadSocket[i] != sk)
+                            continue;
+                        size_t lo, hi;
+                        ChunkRange(n, i, threads[p], &lo, &hi);
+                        socketBytes += (double)(hi - lo) * (double)KERNELS[k].bytesPerElem;
+                        if (ThreadTime[i] > socketTime)
+                            socketTime = ThreadTime[i];
+                    }
+                    socketTime /= (double)ThreadCalls;
+                    printf("\t%8.2lf", socketTime > 0. ? socketBytes / socketTime / 1.e9 : 0.);
+                }
+                printf("\n");
+
+                if (placement == PLACE_FIRSTTOUCH)
+                    FreeArrays(n);
+            }
+
+            // the Amdahl estimate for this size, fitted over every thread count:
+            if (sumFitXX > 0.)
+                printf("%zu\t%s\tfit\t\t\t\t\t\t\t\t\t\t\t\t\t%6.3lf\n", n, KernelName(k), sumFitXY / sumFitXX);
         }
     }
 
-    printf("Avg. performance = %8.2lf MegaMults/Sec\n", sumMegaMults/(double)NUMTRIES);
-    printf("Peak performance = %8.2lf MegaMults/Sec\n", maxMegaMults);
-    printf("Avg. time        = %8.2lf microseconds\n", sumTimeDiff/(double)NUMTRIES);
-    printf("Min. time        = %8.2lf microseconds\n\n", minTimeDiff);
+    if (placement == PLACE_SERIAL)
+        FreeArrays(maxSize);
+    else if (PageFallbacks > 0)
+        fprintf(stderr, "%d allocation(s) fell back to smaller pages\n", PageFallbacks);
 
     return 0;
 }
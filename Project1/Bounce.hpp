@@ -0,0 +1,253 @@
+/******************************************************************************
+** Program name: OpenMP: Monte Carlo Simulation
+** Description: This header file holds one trial of the simulation: a laser
+    fired from the origin along y = x bounces off a circle and either hits the
+    infinite plate at y = 0 or misses. It is a template on the type the
+    circle is stored in and the type the intersection math is done in, so the
+    same code gives pure float, pure double and float-storage/double-math
+    kernels, on the CPU and (through nvcc) in the CUDA kernel. Every constant
+    is converted to the math type, so nothing is promoted behind our backs.
+    The float instantiation does the same operations in the same order as the
+    lanes of BounceSimd.hpp, so the two count the same hits: every product
+    that is added or subtracted goes through BounceMul( ), which the compiler
+    cannot fuse into a multiply-add, so that holds whatever -ffp-contract the
+    build uses (g++ and nvcc both fuse by default, and where they can differs
+    between the scalar and the vector code). BounceCaseFast( ) is the
+    optional float fast path: the square roots and divisions become hardware
+    reciprocal square root and reciprocal estimates, each sharpened by NEWTON
+    Newton-Raphson steps.
+******************************************************************************/
+
+#ifndef BOUNCE_HPP
+#define BOUNCE_HPP
+
+#include <math.h>
+#include <float.h>
+#include <immintrin.h>
+
+#ifdef __CUDACC__
+#define BOUNCE_HD   __host__ __device__
+#else
+#define BOUNCE_HD
+#endif
+
+BOUNCE_HD static inline float   BounceSqrt( float x )   { return sqrtf( x ); }
+BOUNCE_HD static inline double  BounceSqrt( double x )  { return sqrt( x ); }
+
+// a*b, rounded on its own: on the GPU the _rn intrinsics are never contracted, and on the
+// CPU the empty asm hides the product from the compiler, leaving it nothing to fuse; the
+// products that are only multiplied, divided or compared cannot be fused anyway, and are
+// left to the compiler:
+BOUNCE_HD static inline float
+BounceMul( float a, float b )
+{
+#ifdef __CUDA_ARCH__
+    return __fmul_rn( a, b );
+#else
+    float p = a * b;
+    __asm__( "" : "+v"( p ) );
+    return p;
+#endif
+}
+
+BOUNCE_HD static inline double
+BounceMul( double a, double b )
+{
+#ifdef __CUDA_ARCH__
+    return __dmul_rn( a, b );
+#else
+    double p = a * b;
+    __asm__( "" : "+v"( p ) );
+    return p;
+#endif
+}
+
+// the hardware estimates of 1/sqrt(x) and 1/x (about 12 bits on the CPU, 1-2 ulp on the GPU):
+BOUNCE_HD static inline float
+BounceRsqrtEstimate( float x )
+{
+#ifdef __CUDA_ARCH__
+    return rsqrtf( x );
+#else
+    return _mm_cvtss_f32( _mm_rsqrt_ss( _mm_set_ss( x ) ) );
+#endif
+}
+
+BOUNCE_HD static inline float
+BounceRcpEstimate( float x )
+{
+#ifdef __CUDA_ARCH__
+    return __fdividef( 1.f, x );
+#else
+    return _mm_cvtss_f32( _mm_rcp_ss( _mm_set_ss( x ) ) );
+#endif
+}
+
+// the estimates, each Newton-Raphson step roughly doubling their correct bits (x*y first,
+// so an x as small as FLT_MIN never takes the step through a denormal):
+template <int NEWTON>
+BOUNCE_HD static inline float
+BounceRsqrt( float x )
+{
+    float y = BounceRsqrtEstimate( x );
+    for( int i = 0; i < NEWTON; i++ )
+        y = y * ( 1.5f - BounceMul( x*y, 0.5f*y ) );
+    return y;
+}
+
+template <int NEWTON>
+BOUNCE_HD static inline float
+BounceRcp( float x )
+{
+    float y = BounceRcpEstimate( x );
+    for( int i = 0; i < NEWTON; i++ )
+        y = y * ( 2.f - BounceMul( x, y ) );
+    return y;
+}
+
+// the four outcomes of a trial:
+#define BOUNCE_MISSED       0       // case A: the beam misses the circle
+#define BOUNCE_ENGULFED     1       // case B: the circle engulfs the laser
+#define BOUNCE_UP           2       // case C: the beam bounces back up
+#define BOUNCE_HIT          3       // case D: the beam hits the plate
+#define BOUNCE_NUMCASES     4
+
+// which case the beam bounced off the circle (xc,yc,r) ends in:
+template <typename Store, typename Calc>
+BOUNCE_HD static inline int
+BounceCase( Store xcStored, Store ycStored, Store rStored )
+{
+    const Calc ZERO = (Calc)0;
+    const Calc TWO  = (Calc)2;
+    const Calc FOUR = (Calc)4;
+    Calc xc = (Calc)xcStored;
+    Calc yc = (Calc)ycStored;
+    Calc r  = (Calc)rStored;
+
+    // solve for the intersection using the quadratic formula:
+    Calc a = TWO;
+    Calc b = BounceMul( -TWO, xc + yc );
+    Calc c = BounceMul( xc, xc ) + BounceMul( yc, yc ) - BounceMul( r, r );
+    Calc d = BounceMul( b, b ) - BounceMul( FOUR*a, c );
+
+    // case A: circle completely missed (d < 0.)
+    if (d < ZERO)
+        return BOUNCE_MISSED;
+
+    // if not case A, hits the circle:
+    // get the first intersection:
+    d = BounceSqrt( d );
+    Calc t1 = (-b + d ) / ( TWO*a );	// time to intersect the circle
+    Calc t2 = (-b - d ) / ( TWO*a );	// time to intersect the circle
+    Calc tmin = t1 < t2 ? t1 : t2;		// only care about the first intersection
+
+    // case B: circle engulfs line (tmin < 0.)
+    if (tmin < ZERO)
+        return BOUNCE_ENGULFED;
+
+    // if not case A or case B, where does it intersect the circle?
+    Calc xcir = tmin;
+    Calc ycir = tmin;
+
+    // get the unitized normal vector at the point of intersection:
+    Calc nx = xcir - xc;
+    Calc ny = ycir - yc;
+    Calc n = BounceSqrt( BounceMul( nx, nx ) + BounceMul( ny, ny ) );
+    nx /= n;	// unit vector
+    ny /= n;	// unit vector
+
+    // get the unitized incoming vector:
+    Calc inx = xcir - ZERO;
+    Calc iny = ycir - ZERO;
+    Calc in = BounceSqrt( BounceMul( inx, inx ) + BounceMul( iny, iny ) );
+    inx /= in;	// unit vector
+    iny /= in;	// unit vector
+
+    // get the outgoing (bounced) vector:
+    Calc dot = BounceMul( inx, nx ) + BounceMul( iny, ny );
+    Calc outy = iny - BounceMul( TWO*ny, dot );	// angle of reflection = angle of incidence
+
+    // find out if it hits the infinite plate:
+    Calc t = ( ZERO - ycir ) / outy;
+
+    // case C: line bounced back up (t < 0.)
+    if (t < ZERO)
+        return BOUNCE_UP;
+
+    // if not case A, B, or C, line hit the plate
+    return BOUNCE_HIT;
+}
+
+// BounceCase<float, float>( ) without a square root or a division: sqrt(d) is d/sqrt(d)
+// (with d kept off 0, where the estimate is infinite), the divisions by 2a = 4 are exact
+// multiplications by 1/4, the two normalizations multiply by 1/length, and t only needs
+// the reciprocal of outy:
+template <int NEWTON>
+BOUNCE_HD static inline int
+BounceCaseFast( float xc, float yc, float r )
+{
+    float b = BounceMul( -2.f, xc + yc );
+    float c = BounceMul( xc, xc ) + BounceMul( yc, yc ) - BounceMul( r, r );
+    float d = BounceMul( b, b ) - BounceMul( 8.f, c );
+
+    // case A: circle completely missed (d < 0.)
+    if (d < 0.f)
+        return BOUNCE_MISSED;
+
+    d = BounceMul( d, BounceRsqrt<NEWTON>( d > FLT_MIN ? d : FLT_MIN ) );
+    float t1 = (-b + d ) * 0.25f;
+    float t2 = (-b - d ) * 0.25f;
+    float tmin = t1 < t2 ? t1 : t2;
+
+    // case B: circle engulfs line (tmin < 0.)
+    if (tmin < 0.f)
+        return BOUNCE_ENGULFED;
+
+    float xcir = tmin;
+    float ycir = tmin;
+
+    float nx = xcir - xc;
+    float ny = ycir - yc;
+    float rn = BounceRsqrt<NEWTON>( BounceMul( nx, nx ) + BounceMul( ny, ny ) );
+    nx *= rn;
+    ny *= rn;
+
+    float inx = xcir - 0.f;
+    float iny = ycir - 0.f;
+    float rin = BounceRsqrt<NEWTON>( BounceMul( inx, inx ) + BounceMul( iny, iny ) );
+    inx *= rin;
+    iny *= rin;
+
+    float dot = BounceMul( inx, nx ) + BounceMul( iny, ny );
+    float outy = iny - BounceMul( 2.f*ny, dot );
+    float t = ( 0.f - ycir ) * BounceRcp<NEWTON>( outy );
+
+    // case C: line bounced back up (t < 0.)
+    if (t < 0.f)
+        return BOUNCE_UP;
+    return BOUNCE_HIT;
+}
+
+// 1 if the beam hits the plate, 0 if not:
+template <typename Store, typename Calc>
+BOUNCE_HD static inline int
+Bounce( Store xc, Store yc, Store r )
+{
+    return BounceCase<Store, Calc>( xc, yc, r ) == BOUNCE_HIT;
+}
+
+template <int NEWTON>
+BOUNCE_HD static inline int
+BounceFast( float xc, float yc, float r )
+{
+    return BounceCaseFast<NEWTON>( xc, yc, r ) == BOUNCE_HIT;
+}
+
+// the all-float trial every kernel of Proj1.cpp uses:
+BOUNCE_HD static inline int
+Bounce( float xc, float yc, float r )
+{
+    return Bounce<float, float>( xc, yc, r );
+}
+
+#endif
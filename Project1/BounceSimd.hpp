@@ -0,0 +1,234 @@
+/******************************************************************************
+** Program name: OpenMP: Monte Carlo Simulation
+** Description: This header file runs BOUNCE_LANES trials of Bounce.hpp at a
+    time with no branches: every case is computed in every lane, the three
+    early exits become masks, and the hits are counted with a popcount of the
+    combined mask. It uses AVX-512 (16 lanes), AVX (8 lanes) or SSE (4 lanes),
+    whichever the compiler targets, and performs the same float operations in
+    the same order as the scalar Bounce( ), so both count the same hits
+    (BounceVMul( ), like BounceMul( ) there, keeps every product that is
+    added or subtracted out of a fused multiply-add, whatever -ffp-contract
+    the build uses). BounceMaskFast( ) is the lane-wide BounceCaseFast( ):
+    hardware reciprocal square root and reciprocal estimates instead of
+    square roots and divisions, with NEWTON Newton-Raphson steps.
+******************************************************************************/
+
+#ifndef BOUNCESIMD_HPP
+#define BOUNCESIMD_HPP
+
+#include <immintrin.h>
+#include "Bounce.hpp"
+
+// each "x < 0 -> miss" test of the scalar code is kept as "not (x < 0)", so NaNs hit in both:
+#if defined(__AVX512F__)
+#define BOUNCE_LANES        16
+typedef __m512              vfloat;
+typedef __mmask16           vmask;
+#define VSET1(x)            _mm512_set1_ps( x )
+#define VLOAD(p)            _mm512_loadu_ps( p )
+#define VADD(a,b)           _mm512_add_ps( a, b )
+#define VSUB(a,b)           _mm512_sub_ps( a, b )
+#define VMUL(a,b)           _mm512_mul_ps( a, b )
+#define VDIV(a,b)           _mm512_div_ps( a, b )
+#define VSQRT(a)            VSqrt512( a )
+#define VMIN(a,b)           VMin512( a, b )
+#define VMAX(a,b)           VMax512( a, b )
+#define VRSQRT(a)           VRsqrt512( a )
+#define VRCP(a)             VRcp512( a )
+#define VNOTNEG(a)          _mm512_cmp_ps_mask( a, _mm512_setzero_ps( ), _CMP_NLT_UQ )
+#define VAND(m,n)           (vmask)( (m) & (n) )
+#define VBITS(m)            (unsigned int)(m)
+
+// the unmasked forms of these merge into _mm512_undefined_ps( ), which g++ reports as
+// uninitialized under -Wall; all 16 lanes merged over a defined source are the same
+// instructions:
+#define VALLLANES           ( (__mmask16)0xFFFF )
+static inline __m512 VSqrt512( __m512 a )           { return _mm512_mask_sqrt_ps( a, VALLLANES, a ); }
+static inline __m512 VMin512( __m512 a, __m512 b )  { return _mm512_mask_min_ps( a, VALLLANES, a, b ); }
+static inline __m512 VMax512( __m512 a, __m512 b )  { return _mm512_mask_max_ps( a, VALLLANES, a, b ); }
+static inline __m512 VRsqrt512( __m512 a )          { return _mm512_mask_rsqrt14_ps( a, VALLLANES, a ); }
+static inline __m512 VRcp512( __m512 a )            { return _mm512_mask_rcp14_ps( a, VALLLANES, a ); }
+#elif defined(__AVX__)
+#define BOUNCE_LANES        8
+typedef __m256              vfloat;
+typedef __m256              vmask;
+#define VSET1(x)            _mm256_set1_ps( x )
+#define VLOAD(p)            _mm256_loadu_ps( p )
+#define VADD(a,b)           _mm256_add_ps( a, b )
+#define VSUB(a,b)           _mm256_sub_ps( a, b )
+#define VMUL(a,b)           _mm256_mul_ps( a, b )
+#define VDIV(a,b)           _mm256_div_ps( a, b )
+#define VSQRT(a)            _mm256_sqrt_ps( a )
+#define VMIN(a,b)           _mm256_min_ps( a, b )
+#define VMAX(a,b)           _mm256_max_ps( a, b )
+#define VRSQRT(a)           _mm256_rsqrt_ps( a )
+#define VRCP(a)             _mm256_rcp_ps( a )
+#define VNOTNEG(a)          _mm256_cmp_ps( a, _mm256_setzero_ps( ), _CMP_NLT_UQ )
+#define VAND(m,n)           _mm256_and_ps( m, n )
+#define VBITS(m)            (unsigned int)_mm256_movemask_ps( m )
+#else
+#define BOUNCE_LANES        4
+typedef __m128              vfloat;
+typedef __m128              vmask;
+#define VSET1(x)            _mm_set1_ps( x )
+#define VLOAD(p)            _mm_loadu_ps( p )
+#define VADD(a,b)           _mm_add_ps( a, b )
+#define VSUB(a,b)           _mm_sub_ps( a, b )
+#define VMUL(a,b)           _mm_mul_ps( a, b )
+#define VDIV(a,b)           _mm_div_ps( a, b )
+#define VSQRT(a)            _mm_sqrt_ps( a )
+#define VMIN(a,b)           _mm_min_ps( a, b )
+#define VMAX(a,b)           _mm_max_ps( a, b )
+#define VRSQRT(a)           _mm_rsqrt_ps( a )
+#define VRCP(a)             _mm_rcp_ps( a )
+#define VNOTNEG(a)          _mm_cmpnlt_ps( a, _mm_setzero_ps( ) )
+#define VAND(m,n)           _mm_and_ps( m, n )
+#define VBITS(m)            (unsigned int)_mm_movemask_ps( m )
+#endif
+
+// a*b in every lane, hidden from the compiler like BounceMul( ) so it is never fused
+// (used, as there, for the products that are added or subtracted):
+static inline vfloat
+BounceVMul( vfloat a, vfloat b )
+{
+    vfloat p = VMUL( a, b );
+    __asm__( "" : "+v"( p ) );
+    return p;
+}
+
+// one bit per lane of a mask, and how many are set:
+#define VCOUNT(m)           __builtin_popcount( VBITS( m ) )
+
+// which of the BOUNCE_LANES trials starting at xc, yc and r hit the plate, and which got
+// past case A and past case B on the way (so the case counts cost a popcount each):
+static inline vmask
+BounceCaseMasks( const float *xcs, const float *ycs, const float *rs, vmask *pastA, vmask *pastB )
+{
+    vfloat xc = VLOAD( xcs );
+    vfloat yc = VLOAD( ycs );
+    vfloat r  = VLOAD( rs );
+    vfloat zero = VSET1( 0.f );
+    vfloat two  = VSET1( 2.f );
+
+    // solve for the intersection using the quadratic formula:
+    vfloat a = two;
+    vfloat b = BounceVMul( VSET1( -2.f ), VADD( xc, yc ) );
+    vfloat c = VSUB( VADD( BounceVMul( xc, xc ), BounceVMul( yc, yc ) ), BounceVMul( r, r ) );
+    vfloat d = VSUB( BounceVMul( b, b ), BounceVMul( VMUL( VSET1( 4.f ), a ), c ) );
+    vmask hit = VNOTNEG( d );                                   // case A
+    *pastA = hit;
+
+    // the first intersection (NaN in the lanes case A already removed):
+    d = VSQRT( d );
+    vfloat minusB = VSUB( zero, b );
+    vfloat twoA = VMUL( two, a );
+    vfloat t1 = VDIV( VADD( minusB, d ), twoA );
+    vfloat t2 = VDIV( VSUB( minusB, d ), twoA );
+    vfloat tmin = VMIN( t1, t2 );                               // t1 < t2 ? t1 : t2
+    hit = VAND( hit, VNOTNEG( tmin ) );                         // case B
+    *pastB = hit;
+
+    vfloat xcir = tmin;
+    vfloat ycir = tmin;
+
+    // the unitized normal vector at the point of intersection:
+    vfloat nx = VSUB( xcir, xc );
+    vfloat ny = VSUB( ycir, yc );
+    vfloat n = VSQRT( VADD( BounceVMul( nx, nx ), BounceVMul( ny, ny ) ) );
+    nx = VDIV( nx, n );
+    ny = VDIV( ny, n );
+
+    // the unitized incoming vector:
+    vfloat inx = VSUB( xcir, zero );
+    vfloat iny = VSUB( ycir, zero );
+    vfloat in = VSQRT( VADD( BounceVMul( inx, inx ), BounceVMul( iny, iny ) ) );
+    inx = VDIV( inx, in );
+    iny = VDIV( iny, in );
+
+    // the outgoing (bounced) vector and where it meets the plate:
+    vfloat dot = VADD( BounceVMul( inx, nx ), BounceVMul( iny, ny ) );
+    vfloat outy = VSUB( iny, BounceVMul( VMUL( two, ny ), dot ) );
+    vfloat t = VDIV( VSUB( zero, ycir ), outy );
+    hit = VAND( hit, VNOTNEG( t ) );                            // case C
+
+    return hit;
+}
+
+// which of the BOUNCE_LANES trials starting at xc, yc and r hit the plate:
+static inline vmask
+BounceMask( const float *xcs, const float *ycs, const float *rs )
+{
+    vmask pastA, pastB;
+    return BounceCaseMasks( xcs, ycs, rs, &pastA, &pastB );
+}
+
+// the number of hits among the BOUNCE_LANES trials starting at xc, yc and r:
+static inline int
+BounceLanes( const float *xcs, const float *ycs, const float *rs )
+{
+    return VCOUNT( BounceMask( xcs, ycs, rs ) );
+}
+
+// the estimates of 1/sqrt(x) and 1/x with NEWTON Newton-Raphson steps:
+template <int NEWTON>
+static inline vfloat
+VRsqrtNewton( vfloat x )
+{
+    vfloat y = VRSQRT( x );
+    for( int i = 0; i < NEWTON; i++ )
+        y = VMUL( y, VSUB( VSET1( 1.5f ), BounceVMul( VMUL( x, y ), VMUL( VSET1( 0.5f ), y ) ) ) );
+    return y;
+}
+
+template <int NEWTON>
+static inline vfloat
+VRcpNewton( vfloat x )
+{
+    vfloat y = VRCP( x );
+    for( int i = 0; i < NEWTON; i++ )
+        y = VMUL( y, VSUB( VSET1( 2.f ), BounceVMul( x, y ) ) );
+    return y;
+}
+
+// BounceMask( ) with the operations of BounceCaseFast( ):
+template <int NEWTON>
+static inline vmask
+BounceMaskFast( const float *xcs, const float *ycs, const float *rs )
+{
+    vfloat xc = VLOAD( xcs );
+    vfloat yc = VLOAD( ycs );
+    vfloat r  = VLOAD( rs );
+    vfloat zero = VSET1( 0.f );
+    vfloat two  = VSET1( 2.f );
+
+    vfloat b = BounceVMul( VSET1( -2.f ), VADD( xc, yc ) );
+    vfloat c = VSUB( VADD( BounceVMul( xc, xc ), BounceVMul( yc, yc ) ), BounceVMul( r, r ) );
+    vfloat d = VSUB( BounceVMul( b, b ), BounceVMul( VSET1( 8.f ), c ) );
+    vmask hit = VNOTNEG( d );                                   // case A
+
+    d = BounceVMul( d, VRsqrtNewton<NEWTON>( VMAX( d, VSET1( FLT_MIN ) ) ) );
+    vfloat minusB = VSUB( zero, b );
+    vfloat t1 = VMUL( VADD( minusB, d ), VSET1( 0.25f ) );
+    vfloat t2 = VMUL( VSUB( minusB, d ), VSET1( 0.25f ) );
+    vfloat tmin = VMIN( t1, t2 );
+    hit = VAND( hit, VNOTNEG( tmin ) );                         // case B
+
+    vfloat nx = VSUB( tmin, xc );
+    vfloat ny = VSUB( tmin, yc );
+    vfloat rn = VRsqrtNewton<NEWTON>( VADD( BounceVMul( nx, nx ), BounceVMul( ny, ny ) ) );
+    nx = VMUL( nx, rn );
+    ny = VMUL( ny, rn );
+
+    vfloat inx = VSUB( tmin, zero );
+    vfloat iny = VSUB( tmin, zero );
+    vfloat rin = VRsqrtNewton<NEWTON>( VADD( BounceVMul( inx, inx ), BounceVMul( iny, iny ) ) );
+    inx = VMUL( inx, rin );
+    iny = VMUL( iny, rin );
+
+    vfloat dot = VADD( BounceVMul( inx, nx ), BounceVMul( iny, ny ) );
+    vfloat outy = VSUB( iny, BounceVMul( VMUL( two, ny ), dot ) );
+    vfloat t = VMUL( VSUB( zero, tmin ), VRcpNewton<NEWTON>( outy ) );
+    return VAND( hit, VNOTNEG( t ) );                           // case C
+}
+
+#endif
@@ -0,0 +1,87 @@
+/******************************************************************************
+** Program name: OpenMP: Monte Carlo Simulation
+** Description: This header file saves and restores the state of a long
+    chunked run in a small binary file. The chunks are run in epochs, and an
+    epoch ends only when all of its chunks are done, so the state is just the
+    first chunk not yet run and the hits so far; every chunk seeds its own
+    xoshiro stream from (seed, chunk), so that chunk number is also the
+    position of the random streams. The file is written to a temporary name,
+    flushed to disk and renamed over the old one, so a run killed in the
+    middle of a write still leaves the previous checkpoint intact.
+******************************************************************************/
+
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CHECKPOINT_MAGIC    0x4B43504Du     // "MPCK"
+#define CHECKPOINT_VERSION  1
+
+struct Checkpoint
+{
+    uint32_t  magic;
+    uint32_t  version;
+    uint64_t  seed;
+    int64_t   numTrials;
+    int64_t   chunkTrials;
+    int64_t   nextChunk;        // chunks 0 ... nextChunk-1 are done
+    int64_t   numHits;          // the hits in those chunks
+    double    seconds;          // run time spent on them, over all the sessions
+    uint64_t  check;            // FNV-1a hash of everything above
+};
+
+static inline uint64_t
+CheckpointHash( const struct Checkpoint *ck )
+{
+    const unsigned char *p = (const unsigned char *)ck;
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for( size_t i = 0; i < offsetof( struct Checkpoint, check ); i++ )
+        h = ( h ^ p[i] ) * 0x100000001B3ULL;
+    return h;
+}
+
+// returns 1 once the checkpoint is safely on disk, 0 (and the old file untouched) if not:
+static inline int
+CheckpointWrite( const char *path, struct Checkpoint *ck )
+{
+    char tmp[4096];
+    if( snprintf( tmp, sizeof(tmp), "%s.tmp", path ) >= (int)sizeof(tmp) )
+        return 0;
+
+    ck->magic = CHECKPOINT_MAGIC;
+    ck->version = CHECKPOINT_VERSION;
+    ck->check = CheckpointHash( ck );
+
+    FILE *fp = fopen( tmp, "wb" );
+    if( fp == NULL )
+        return 0;
+    int ok = fwrite( ck, sizeof(*ck), 1, fp ) == 1;
+    ok = fflush( fp ) == 0 && ok;
+    ok = fsync( fileno( fp ) ) == 0 && ok;
+    ok = fclose( fp ) == 0 && ok;
+    if( ok )
+        ok = rename( tmp, path ) == 0;
+    if( !ok )
+        remove( tmp );
+    return ok;
+}
+
+// returns 1 if path holds a complete, uncorrupted checkpoint, 0 if not:
+static inline int
+CheckpointRead( const char *path, struct Checkpoint *ck )
+{
+    FILE *fp = fopen( path, "rb" );
+    if( fp == NULL )
+        return 0;
+    int ok = fread( ck, sizeof(*ck), 1, fp ) == 1;
+    fclose( fp );
+    return ok && ck->magic == CHECKPOINT_MAGIC && ck->version == CHECKPOINT_VERSION
+              && ck->check == CheckpointHash( ck );
+}
+
+#endif
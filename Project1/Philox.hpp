@@ -0,0 +1,61 @@
+/******************************************************************************
+** Program name: OpenMP: Monte Carlo Simulation
+** Description: This header file implements the Philox4x32-10 counter-based
+    random number generator (Salmon et al., "Parallel Random Numbers: As Easy
+    as 1, 2, 3", SC11). Each call maps a 128-bit counter and a 64-bit key to
+    four independent 32-bit random words with no state, so trial n can make
+    its own random numbers from n alone, on any thread, in any order.
+******************************************************************************/
+
+#ifndef PHILOX_HPP
+#define PHILOX_HPP
+
+#include <stdint.h>
+
+#define PHILOX_M0       0xD2511F53u
+#define PHILOX_M1       0xCD9E8D57u
+#define PHILOX_W0       0x9E3779B9u            // golden ratio
+#define PHILOX_W1       0xBB67AE85u            // sqrt(3) - 1
+#define PHILOX_ROUNDS   10
+
+struct Philox4
+{
+    uint32_t v[4];
+};
+
+static inline struct Philox4
+Philox4x32( uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, uint32_t k0, uint32_t k1 )
+{
+    for( int round = 0; round < PHILOX_ROUNDS; round++ )
+    {
+        uint64_t p0 = (uint64_t)PHILOX_M0 * c0;
+        uint64_t p1 = (uint64_t)PHILOX_M1 * c2;
+        uint32_t n0 = (uint32_t)( p1 >> 32 ) ^ c1 ^ k0;
+        uint32_t n2 = (uint32_t)( p0 >> 32 ) ^ c3 ^ k1;
+        c1 = (uint32_t)p1;
+        c3 = (uint32_t)p0;
+        c0 = n0;
+        c2 = n2;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    struct Philox4 out = { { c0, c1, c2, c3 } };
+    return out;
+}
+
+// the four random words for trial number n of the stream chosen by seed:
+static inline struct Philox4
+PhiloxTrial( uint64_t n, uint64_t seed )
+{
+    return Philox4x32( (uint32_t)n, (uint32_t)( n >> 32 ), 0u, 0u, (uint32_t)seed, (uint32_t)( seed >> 32 ) );
+}
+
+// a float between low and high from one random word (the top 24 bits, so every value is exact):
+static inline float
+PhiloxRanf( uint32_t word, float low, float high )
+{
+    float t = (float)( word >> 8 ) * ( 1.f / 16777216.f );     // 0. - 1.
+    return low + t * ( high - low );
+}
+
+#endif
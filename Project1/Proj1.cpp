@@ -9,9 +9,134 @@
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
 #include <time.h>
+#include <signal.h>
 #include <omp.h>
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
 #include "Proj1.hpp"
+#include "Bounce.hpp"
+#include "BounceSimd.hpp"
+#include "Philox.hpp"
+#include "Xoshiro.hpp"
+#include "Sampling.hpp"
+#include "Sobol.hpp"
+#include "Checkpoint.hpp"
+#include "../Common/Bench.h"
+#include "../Common/Pages.h"
+
+// usage:  ./Proj1 [-k scalar|simd] [-s seed] [-v]
+//         ./Proj1 [-k scalar|simd] [-s seed] -c chunk
+//         ./Proj1 [-k scalar|simd] [-s seed] -S plain|stratified|antithetic|lhs|all [-r replicates]
+//         ./Proj1 [-k scalar|simd] [-s seed] -Q [-r replicates]
+//         ./Proj1 [-k scalar|simd] [-s seed] -P configfile
+//         ./Proj1 [-k scalar|simd] [-s seed] -e halfwidth [-n batchtrials] [-m maxtrials]
+//         ./Proj1 [-s seed] -p tolerance
+//         ./Proj1 [-k scalar|simd] [-s seed] -O
+//         ./Proj1 [-s seed] -F
+//         ./Proj1 [-k scalar|simd] [-s seed] -C checkfile | -R checkfile [-i seconds]
+//      (two modes, or an option the mode does not take, are a usage error)
+//      -k picks the trial kernel: the scalar Bounce( ) loop (the default) or the
+//      branchless BOUNCE_LANES-wide one; -v runs both once on the same trials,
+//      prints their hit counts, and fails if they differ (both round every
+//      product on its own, so they agree under any -ffp-contract);
+//      -e ignores NUMTRIALS and runs Philox trials in parallel batches (always
+//      Philox, so any number of trials fits in memory) until the 95% confidence
+//      interval of the hit probability is no wider than +- halfwidth, or until
+//      maxtrials, and reports the interval, the trials used and the time it took;
+//      built with mpicxx -DUSE_MPI and run as mpirun -np N ./Proj1 [-k scalar|simd],
+//      the NUMTRIALS Philox trials are split into one contiguous counter range per
+//      rank (so no two ranks draw the same numbers, and the hits match a
+//      single-process run), each rank runs its range with NUMT OpenMP threads, and
+//      rank 0 prints per-rank throughput, the cost of the hit reduction, and the
+//      end-to-end aggregate rate (-C, -R, -F, -O, -S, -Q, -P, -c, -e, -p and -v
+//      are single-process modes);
+//      -s replaces the SEED of the Philox and chunked streams, and -c reruns one
+//      chunk of an RNG_CHUNKED run by itself and prints its hits;
+//      -S splits NUMTRIALS into independent replicates of a sampling design and
+//      reports the variance of the estimate across them, and the variance
+//      reduction factor against plain Monte Carlo with the same trials,
+//      p(1-p)/n divided by that variance;
+//      -Q runs the quasi-Monte Carlo engine (Owen-scrambled Sobol points) and plain
+//      Philox Monte Carlo side by side for 1K, 2K, 4K, ... up to NUMTRIALS trials,
+//      each over independent replicates, and prints the standard error of both
+//      against the trial count with the fitted convergence rate of each;
+//      -P sweeps many geometries in one pass: each line of configfile ('-' is
+//      stdin, '#' starts a comment) holds XCMIN XCMAX YCMIN YCMAX RMIN RMAX and
+//      nothing else, or is blank, any other line being an error; every
+//      configuration gets NUMTRIALS trials, and the work is split into
+//      (SWEEPBLOCK configurations, SWEEPCHUNK trials) items handed out
+//      dynamically; an item draws its chunk's random numbers once and maps them
+//      into each of its configurations, so all of them see the same underlying
+//      points (common random numbers) and the hits do not depend on NUMT;
+//      -p times the Bounce<Store, Calc>( ) template on the same NUMTRIALS Philox
+//      trials as pure float, pure double, and float storage with double math,
+//      counts the trials where each decides differently from the pure double
+//      reference, and marks the variants whose hit probability is within
+//      +- tolerance of the reference's;
+//      -C runs the chunks of an RNG_CHUNKED run in epochs of CHECKPOINTEPOCH
+//      chunks and, at the end of an epoch, at least every -i seconds (default
+//      CHECKPOINTSECONDS), saves the chunks done and their hits to checkfile;
+//      -R reads checkfile back and carries on from the first chunk not done,
+//      checkpointing to the same file, with the same hits as an uninterrupted
+//      run; SIGINT or SIGTERM stops either at the end of the current epoch,
+//      after one last checkpoint;
+//      -O counts every outcome (A missed, B engulfed, C bounced up, D hit) on the
+//      NUMTRIALS trials of RNG_ARRAYS or RNG_PHILOX with the -k kernel, each
+//      thread in its own cache line of counters, and times it against the
+//      hit-only loop of the same kernel (the scalar loop packs the four counts
+//      into one register, the SIMD one popcounts the masks it already builds);
+//      -F times the fast path (hardware rsqrt/rcp estimates with 0 to FASTMAXNEWTON
+//      Newton steps) against the exact kernels, scalar and SIMD, on the same
+//      NUMTRIALS Philox circles held in arrays, and counts the trials each variant
+//      classifies differently from the exact path
+
+#define KERNEL_SCALAR	0
+#define KERNEL_SIMD	1
+
+// the adaptive mode's defaults, and the normal quantile of its 95% interval:
+#define ADAPTIVEBATCH		( 1LL << 20 )
+#define ADAPTIVEMAXTRIALS	( 1LL << 40 )
+#define ADAPTIVEMINBATCHES	2
+#define Z95			1.959964
+
+// replicates of each design in the variance-reduction mode:
+#define VRREPLICATES		32
+
+// replicates of each trial count in the QMC comparison, and the smallest count:
+#define QMCREPLICATES		16
+#define QMCMINTRIALS		1024
+
+// the work items of the parameter sweep:
+#define SWEEPCHUNK		4096
+#define SWEEPBLOCK		16
+
+// the variants of the precision comparison (the pure double one is the reference):
+#define PREC_FLOAT		0
+#define PREC_DOUBLE		1
+#define PREC_MIXED		2
+#define PREC_NUMVARIANTS	3
+
+// each thread's case counters fill a line of their own, so no two threads ever share one:
+#define CACHELINE		64
+
+// the scalar case count keeps the four counts in 16-bit fields of one register, and adds
+// them to the totals before any field can overflow:
+#define CASEPACKBITS		16
+#define CASEPACKTRIALS		( ( 1 << CASEPACKBITS ) - 1 )
+
+// the most Newton steps the fast-path comparison tries (0 is the bare estimates):
+#define FASTMAXNEWTON		2
+
+// chunks per epoch of a checkpointed run, and the default time between checkpoints:
+#define CHECKPOINTEPOCH		256
+#define CHECKPOINTSECONDS	60.
+
+// timed samples of each collective step in the MPI build (fixed, so every rank makes the same calls):
+#define MPIRUNS			50
 
 // setting the number of threads:
 #ifndef NUMT
@@ -23,9 +148,39 @@
 #define NUMTRIALS	1000000
 #endif
 
-// how many tries to discover the maximum performance:
-#ifndef NUMTRIES
-#define NUMTRIES	10
+// where each trial's circle comes from:
+//   RNG_ARRAYS: arrays pre-filled with rand( ) before timing (12 bytes per trial)
+//   RNG_PHILOX: a counter-based generator keyed by the trial number, inside the
+//               timed loop, in constant memory and with the same hits for any NUMT
+//   RNG_CHUNKED: the trials are cut into CHUNKTRIALS-sized chunks, each drawing in
+//               order from its own xoshiro stream seeded by (seed, chunk number);
+//               the chunks are handed out dynamically, yet the hits are the same
+//               for any NUMT, any schedule and either kernel (Bounce.hpp keeps the
+//               kernels' products unfused, so they agree in any build), and any one
+//               chunk can be rerun alone
+#define RNG_ARRAYS	0
+#define RNG_PHILOX	1
+#define RNG_CHUNKED	2
+#ifndef RNG
+#define RNG		RNG_ARRAYS
+#endif
+
+#ifndef CHUNKTRIALS
+#define CHUNKTRIALS	65536
+#endif
+
+#define NUMCHUNKS	( ( (long long)NUMTRIALS + CHUNKTRIALS - 1 ) / CHUNKTRIALS )
+
+// the Philox and chunked streams; changing it gives an independent set of trials:
+#ifndef SEED
+#define SEED		0
+#endif
+
+uint64_t	Seed = SEED;
+
+// page kind for the random-value arrays: PAGES_SMALL, PAGES_THP or PAGES_HUGETLB:
+#ifndef PAGES
+#define PAGES		PAGES_SMALL
 #endif
 
 // ranges for the random numbers:
@@ -40,6 +195,31 @@ const float RMAX  =	 2.0;
 float		Ranf( float, float );
 int		Ranf( int, int );
 void		TimeOfDaySeed( );
+void		RunTrials( void * );
+int		Adaptive( int, double, long long, long long );
+long long	ChunkHits( int, long long );
+long long	TrialsChunked( int, long long, long long );
+int		VarianceReduction( int, int, int );
+int		QmcConvergence( int, int );
+int		Sweep( int, const char * );
+int		Precision( double );
+int		Checkpointed( int, const char *, int, double );
+int		Outcomes( int, const float *, const float *, const float * );
+int		FastMath( );
+#ifdef USE_MPI
+int		Distributed( int );
+#endif
+
+// one timed pass over all the trials, handed to the benchmark engine
+// (the arrays are NULL in the Philox mode):
+struct TrialRun
+{
+    int       kernel;
+    float     *xcs;
+    float     *ycs;
+    float     *rs;
+    long long numHits;
+};
 
 // main program:
 int
@@ -50,123 +230,1498 @@ main( int argc, char *argv[ ] )
 	return 1;
 #endif
 
+    int kernel = KERNEL_SCALAR;
+    int verify = 0;
+    double target = 0.;
+    long long batch = ADAPTIVEBATCH;
+    long long maxTrials = ADAPTIVEMAXTRIALS;
+    long long chunk = -1;
+    int sampling = -1;                      // -1 is the fixed-count run, SAMPLE_NUMMODES runs every design
+    int replicates = 0;                     // 0 is the default of the mode
+    int qmc = 0;
+    const char *sweepFile = NULL;
+    double tolerance = -1.;
+    const char *checkFile = NULL;
+    int resume = 0;
+    int outcomes = 0;
+    int fastMath = 0;
+    double interval = CHECKPOINTSECONDS;
+    int kernelGiven = 0, trialsGiven = 0, intervalGiven = 0;   // options only some modes take
+    for( int a = 1; a < argc; a++ )
+    {
+        if( strcmp( argv[a], "-k" ) == 0 && a+1 < argc )
+        {
+            a++;
+            if( strcmp( argv[a], "scalar" ) == 0 )
+                kernel = KERNEL_SCALAR;
+            else if( strcmp( argv[a], "simd" ) == 0 )
+                kernel = KERNEL_SIMD;
+            else
+            {
+                fprintf( stderr, "Bad kernel '%s' (scalar or simd)\n", argv[a] );
+                return 1;
+            }
+            kernelGiven = 1;
+            continue;
+        }
+        if( strcmp( argv[a], "-v" ) == 0 )
+        {
+            verify = 1;
+            continue;
+        }
+        if( strcmp( argv[a], "-s" ) == 0 && a+1 < argc )
+        {
+            Seed = strtoull( argv[++a], NULL, 0 );
+            continue;
+        }
+        if( strcmp( argv[a], "-c" ) == 0 && a+1 < argc )
+        {
+            chunk = atoll( argv[++a] );
+            if( RNG != RNG_CHUNKED || chunk < 0 || chunk >= NUMCHUNKS )
+            {
+                fprintf( stderr, "-c needs RNG_CHUNKED and a chunk from 0 to %lld\n", NUMCHUNKS-1 );
+                return 1;
+            }
+            continue;
+        }
+        if( strcmp( argv[a], "-S" ) == 0 && a+1 < argc )
+        {
+            a++;
+            sampling = strcmp( argv[a], "all" ) == 0 ? SAMPLE_NUMMODES : ParseSampling( argv[a] );
+            if( sampling < 0 )
+            {
+                fprintf( stderr, "Bad sampling '%s' (plain, stratified, antithetic, lhs or all)\n", argv[a] );
+                return 1;
+            }
+            continue;
+        }
+        if( strcmp( argv[a], "-r" ) == 0 && a+1 < argc )
+        {
+            replicates = atoi( argv[++a] );
+            if( replicates < 2 || replicates > NUMTRIALS / QMCMINTRIALS )
+            {
+                fprintf( stderr, "Bad replicate count '%s'\n", argv[a] );
+                return 1;
+            }
+            continue;
+        }
+        if( strcmp( argv[a], "-P" ) == 0 && a+1 < argc )
+        {
+            sweepFile = argv[++a];
+            continue;
+        }
+        if( strcmp( argv[a], "-O" ) == 0 )
+        {
+            if( RNG == RNG_CHUNKED )
+            {
+                fprintf( stderr, "-O needs RNG_ARRAYS or RNG_PHILOX\n" );
+                return 1;
+            }
+            outcomes = 1;
+            continue;
+        }
+        if( strcmp( argv[a], "-F" ) == 0 )
+        {
+            fastMath = 1;
+            continue;
+        }
+        if( strcmp( argv[a], "-Q" ) == 0 )
+        {
+            qmc = 1;
+            continue;
+        }
+        if( strcmp( argv[a], "-p" ) == 0 && a+1 < argc )
+        {
+            tolerance = atof( argv[++a] );
+            if( tolerance < 0. )
+            {
+                fprintf( stderr, "Bad tolerance '%s'\n", argv[a] );
+                return 1;
+            }
+            continue;
+        }
+        if( ( strcmp( argv[a], "-C" ) == 0 || strcmp( argv[a], "-R" ) == 0 ) && a+1 < argc )
+        {
+            if( RNG != RNG_CHUNKED )
+            {
+                fprintf( stderr, "%s needs RNG_CHUNKED\n", argv[a] );
+                return 1;
+            }
+            resume = argv[a][1] == 'R';
+            checkFile = argv[++a];
+            continue;
+        }
+        if( strcmp( argv[a], "-i" ) == 0 && a+1 < argc )
+        {
+            interval = atof( argv[++a] );
+            if( interval < 0. )
+            {
+                fprintf( stderr, "Bad checkpoint interval '%s'\n", argv[a] );
+                return 1;
+            }
+            intervalGiven = 1;
+            continue;
+        }
+        if( strcmp( argv[a], "-e" ) == 0 && a+1 < argc )
+        {
+            target = atof( argv[++a] );
+            if( target <= 0. )
+            {
+                fprintf( stderr, "Bad half-width '%s'\n", argv[a] );
+                return 1;
+            }
+            continue;
+        }
+        if( ( strcmp( argv[a], "-n" ) == 0 || strcmp( argv[a], "-m" ) == 0 ) && a+1 < argc )
+        {
+            long long value = (long long)atof( argv[a+1] );
+            if( value < 1 )
+            {
+                fprintf( stderr, "Bad trial count '%s'\n", argv[a+1] );
+                return 1;
+            }
+            if( argv[a][1] == 'n' )
+                batch = value;
+            else
+                maxTrials = value;
+            trialsGiven = 1;
+            a++;
+            continue;
+        }
+        fprintf( stderr, "Usage: %s [-k scalar|simd] [-s seed] [-v | -c chunk | -S sampling [-r replicates] | -Q [-r replicates] | -P configfile | -p tolerance | -O | -F | -C|-R checkfile [-i seconds] | -e halfwidth [-n batchtrials] [-m maxtrials]]\n", argv[0] );
+        return 1;
+    }
+
+    // one mode at a time, and only the options it takes, rather than quietly ignoring the rest:
+    int modes = verify + ( chunk >= 0 ) + ( sampling >= 0 ) + qmc + ( sweepFile != NULL ) + ( target > 0. ) +
+                ( tolerance >= 0. ) + outcomes + fastMath + ( checkFile != NULL );
+    if( modes > 1 )
+    {
+        fprintf( stderr, "-v, -c, -S, -Q, -P, -e, -p, -O, -F and -C|-R are separate modes; pick one\n" );
+        return 1;
+    }
+    if( replicates > 0 && sampling < 0 && !qmc )
+    {
+        fprintf( stderr, "-r only goes with -S or -Q\n" );
+        return 1;
+    }
+    if( trialsGiven && target <= 0. )
+    {
+        fprintf( stderr, "-n and -m only go with -e\n" );
+        return 1;
+    }
+    if( intervalGiven && checkFile == NULL )
+    {
+        fprintf( stderr, "-i only goes with -C or -R\n" );
+        return 1;
+    }
+    if( kernelGiven && ( tolerance >= 0. || fastMath ) )
+    {
+        fprintf( stderr, "-p and -F do not take -k\n" );
+        return 1;
+    }
+
+#ifdef USE_MPI
+    // only the main thread of each rank makes MPI calls, outside the OpenMP regions:
+    int provided;
+    MPI_Init_thread( &argc, &argv, MPI_THREAD_FUNNELED, &provided );
+    int size;
+    MPI_Comm_size( MPI_COMM_WORLD, &size );
+    if( size > 1 && ( verify || outcomes || fastMath || target > 0. || tolerance >= 0. || checkFile != NULL || chunk >= 0 || sampling >= 0 || qmc || sweepFile != NULL ) )
+    {
+        fprintf( stderr, "-C, -R, -F, -O, -S, -Q, -P, -c, -e, -p and -v run in a single process only\n" );
+        MPI_Finalize( );
+        return 1;
+    }
+    if( size > 1 )
+    {
+        omp_set_num_threads( NUMT );
+        int status = Distributed( kernel );
+        MPI_Finalize( );
+        return status;
+    }
+    MPI_Finalize( );
+#endif
+
     TimeOfDaySeed( );		            // seed the random number generator
 
     omp_set_num_threads( NUMT );	    // set the number of threads to use in the for-loop:`
 
-    // better to define these here so that the rand() calls don't get into the thread timing:
-    float *xcs = new float [NUMTRIALS];
-    float *ycs = new float [NUMTRIALS];
-    float * rs = new float [NUMTRIALS];
-
-    // fill the random-value arrays:
-    for( int n = 0; n < NUMTRIALS; n++ )
-    {       
-        xcs[n] = Ranf( XCMIN, XCMAX );
-        ycs[n] = Ranf( YCMIN, YCMAX );
-        rs[n] = Ranf(  RMIN,  RMAX ); 
-    }       
-
-    // get ready to record the maximum performance and the probability:
-    float maxPerformance = 0.;      // must be declared outside the NUMTRIES loop
-    float currentProb;              // must be declared outside the NUMTRIES loop
-    double sumMegaTrials = 0.;
-    double bestExecutionTime = 99999.;
-
-    // looking for the maximum performance:
-    for( int t = 0; t < NUMTRIES; t++ )
+    if( target > 0. )
+        return Adaptive( kernel, target, batch, maxTrials );
+
+    if( sampling >= 0 )
+        return VarianceReduction( kernel, sampling, replicates > 0 ? replicates : VRREPLICATES );
+    if( qmc )
+        return QmcConvergence( kernel, replicates > 0 ? replicates : QMCREPLICATES );
+    if( sweepFile != NULL )
+        return Sweep( kernel, sweepFile );
+    if( tolerance >= 0. )
+        return Precision( tolerance );
+    if( checkFile != NULL )
+        return Checkpointed( kernel, checkFile, resume, interval );
+    if( fastMath )
+        return FastMath( );
+
+    // one chunk of a chunked run, alone, for chasing down an outlier:
+    if( chunk >= 0 )
     {
         double time0 = omp_get_wtime( );
+        long long hits = ChunkHits( kernel, chunk );
+        double seconds = omp_get_wtime( ) - time0;
+        long long first = chunk * CHUNKTRIALS;
+        long long count = NUMTRIALS - first < CHUNKTRIALS ? NUMTRIALS - first : CHUNKTRIALS;
+        printf("RNG: chunked, seed %llu, chunk %lld of %lld (trials %lld - %lld)\n",
+            (unsigned long long)Seed, chunk, NUMCHUNKS, first, first + count - 1);
+        printf("Kernel: %s\n", kernel == KERNEL_SIMD ? "simd" : "scalar");
+        printf("Hits: %lld of %lld\nHit probability: %8.4lf\nTime: %.3lf msec\n", hits, count, (double)hits / (double)count, seconds*1000.);
+        return 0;
+    }
+
+    // better to define these here so that the rand() calls don't get into the thread timing:
+    // (on the PAGES kind of page, so the dTLB cost of the three streams can be compared):
+    size_t arrayBytes = RNG == RNG_ARRAYS ? (size_t)NUMTRIALS * sizeof(float) : 0;
+    float *xcs = NULL;
+    float *ycs = NULL;
+    float * rs = NULL;
+    if( RNG == RNG_ARRAYS )
+    {
+        xcs = (float *)PageAlloc( arrayBytes, PAGES );
+        ycs = (float *)PageAlloc( arrayBytes, PAGES );
+         rs = (float *)PageAlloc( arrayBytes, PAGES );
+        if( xcs == NULL || ycs == NULL || rs == NULL )
+        {
+            fprintf( stderr, "Cannot allocate the random-value arrays\n" );
+            return 1;
+        }
+
+        // fill the random-value arrays:
+        for( long long n = 0; n < NUMTRIALS; n++ )
+        {
+            xcs[n] = Ranf( XCMIN, XCMAX );
+            ycs[n] = Ranf( YCMIN, YCMAX );
+            rs[n] = Ranf(  RMIN,  RMAX );
+        }
+    }
+
+    // both kernels must agree hit for hit on the same trials:
+    if( verify )
+    {
+        struct TrialRun scalarRun = { KERNEL_SCALAR, xcs, ycs, rs, 0 };
+        struct TrialRun simdRun   = { KERNEL_SIMD,   xcs, ycs, rs, 0 };
+        RunTrials( &scalarRun );
+        RunTrials( &simdRun );
+        printf( "Scalar hits: %lld\nSIMD hits (%d lanes): %lld\n", scalarRun.numHits, BOUNCE_LANES, simdRun.numHits );
+        printf( "%s\n", scalarRun.numHits == simdRun.numHits ? "Kernels agree" : "Kernels DIFFER" );
+        PageFree( xcs, arrayBytes, PAGES );
+        PageFree( ycs, arrayBytes, PAGES );
+        PageFree( rs, arrayBytes, PAGES );
+        return scalarRun.numHits == simdRun.numHits ? 0 : 1;
+    }
+
+    if( outcomes )
+    {
+        int status = Outcomes( kernel, xcs, ycs, rs );
+        PageFree( xcs, arrayBytes, PAGES );
+        PageFree( ycs, arrayBytes, PAGES );
+        PageFree( rs, arrayBytes, PAGES );
+        return status;
+    }
+
+    // time the trials with the benchmark engine (warm-ups, percentiles, run until stable):
+    struct BenchConfig config = BENCH_DEFAULTS;
+    struct BenchStats stats;
+    struct TrialRun run = { kernel, xcs, ycs, rs, 0 };
+    TlbOpen( );
+    long long tlb0 = TlbRead( );
+    BenchRun( &config, RunTrials, &run, &stats );
+    long long tlb1 = TlbRead( );
+    TlbClose( );
+
+    float currentProb = (float)run.numHits/(float)NUMTRIALS;
+    double megaTrialsPerSecond = (double)NUMTRIALS / stats.median / 1000000.;
 
-        int numHits = 0;
-        #pragma omp parallel for default(none) shared(xcs,ycs,rs) reduction(+:numHits)
-        for( int n = 0; n < NUMTRIALS; n++ )
-	{
-            // randomize the location and radius of the circle:
-	    float xc = xcs[n];
-	    float yc = ycs[n];
-	    float  r =  rs[n];
-
-	    // solve for the intersection using the quadratic formula:
-	    float a = 2.;
-	    float b = -2.*( xc + yc );
-	    float c = xc*xc + yc*yc - r*r;
-	    float d = b*b - 4.*a*c;
-    
-            // case A: circle completely missed (d < 0.)
-            if (d < 0.) 
-                continue;
-            
-            // if not case A, hits the circle:
-            // get the first intersection:
-	    d = sqrt( d );
-	    float t1 = (-b + d ) / ( 2.*a );	// time to intersect the circle
-	    float t2 = (-b - d ) / ( 2.*a );	// time to intersect the circle
-	    float tmin = t1 < t2 ? t1 : t2;		// only care about the first intersection
-
-            // case B: circle engulfs line (tmin < 0.)
-            if (tmin < 0.)
-                continue; 
-
-            // if not case A or case B, where does it intersect the circle?
-            float xcir = tmin;
-	    float ycir = tmin;
-
-	    // get the unitized normal vector at the point of intersection:
-	    float nx = xcir - xc;
-	    float ny = ycir - yc;
-	    float n = sqrt( nx*nx + ny*ny );
-	    nx /= n;	// unit vector
-	    ny /= n;	// unit vector
-
-	    // get the unitized incoming vector:
-	    float inx = xcir - 0.;
-	    float iny = ycir - 0.;
-	    float in = sqrt( inx*inx + iny*iny );
-	    inx /= in;	// unit vector
-	    iny /= in;	// unit vector
-
-	    // get the outgoing (bounced) vector:
-	    float dot = inx*nx + iny*ny;
-	    float outx = inx - 2.*nx*dot;	// angle of reflection = angle of incidence`
-	    float outy = iny - 2.*ny*dot;	// angle of reflection = angle of incidence`
-
-	    // find out if it hits the infinite plate:
-	     float t = ( 0. - ycir ) / outy;
-                
-            // case C: line bounced back up (t < 0.)
-            if (t < 0.)
-                continue; 
-
-            // if not case A, B, or C, line hit the plate
-            numHits += 1;
-        }                                       // end num trials loop
-
-        double time1 = omp_get_wtime( );
-        double executionTime = ( time1 - time0 ) * 1000000.;  
-
-	double megaTrialsPerSecond = (double)NUMTRIALS / ( time1 - time0 ) / 1000000.;
-        sumMegaTrials += megaTrialsPerSecond;
-	if( megaTrialsPerSecond > maxPerformance )
-        {
-		maxPerformance = megaTrialsPerSecond;
-                bestExecutionTime = executionTime;
-        }        
-	currentProb = (float)numHits/(float)NUMTRIALS;
-
-    }                                           // end num tries loop (find maximum performance)
-        
         // Print out: (1) the number of threads, (2) the number of trials, 
-        // (3) the probability of hitting the plate, and (4) the MegaTrialsPerSecond. 
+        // (3) the probability of hitting the plate, and (4) the median MegaTrialsPerSecond. 
         // Printing this as a single line with tabs between the numbers is nice so that you can import these lines right into Excel. 
-        printf("Best execution time: %8.2lf\n", bestExecutionTime);
-        printf("Num threads: %8i\nNum trials: %8i\nHit probability: %8.2lf\nMegaTrials/Sec: %8.2lf\n", NUMT, NUMTRIALS, currentProb, maxPerformance); 
-        printf("%i\t%i\t%8.2lf\t%8.2lf\n", NUMT, NUMTRIALS, currentProb, maxPerformance);
+        BenchPrint( &stats, (double)NUMTRIALS, "Trials" );
+        printf("Kernel: %s\n", kernel == KERNEL_SIMD ? "simd" : "scalar");
+        if( RNG == RNG_PHILOX )
+            printf("RNG: philox, seed %llu (no arrays)\n", (unsigned long long)Seed);
+        if( RNG == RNG_CHUNKED )
+            printf("RNG: chunked, seed %llu, %lld chunks of %d (no arrays)\nHits: %lld\n",
+                (unsigned long long)Seed, NUMCHUNKS, CHUNKTRIALS, run.numHits);
+        printf("Pages: %s (%zu bytes on huge pages, %d fallback(s))\n", PagesName( PAGES ), PagesHugeBytes( ), PageFallbacks);
+        if( tlb0 >= 0 && tlb1 >= 0 )
+            printf("dTLB misses/KTrial: %8.3lf\n", (double)( tlb1 - tlb0 ) / (double)( stats.runs + config.warmups ) / ( NUMTRIALS / 1000. ));
+        else
+            printf("dTLB misses/KTrial: %8s\n", "-");
+        printf("Num threads: %8i\nNum trials: %8lld\nHit probability: %8.2lf\nMegaTrials/Sec: %8.2lf\n", NUMT, (long long)NUMTRIALS, currentProb, megaTrialsPerSecond);
+        printf("%i\t%lld\t%8.2lf\t%8.2lf\n", NUMT, (long long)NUMTRIALS, currentProb, megaTrialsPerSecond);
 
-        delete [] xcs;
-        delete [] ycs;
-        delete [] rs;
+        PageFree( xcs, arrayBytes, PAGES );
+        PageFree( ycs, arrayBytes, PAGES );
+        PageFree( rs, arrayBytes, PAGES );
 
         return 0;
 }                                               // end main
 
+// the circle of trial n in the Philox mode, from the trial number alone:
+static inline void
+PhiloxCircle( long long n, float *xc, float *yc, float *r )
+{
+    Philox4 u = PhiloxTrial( (uint64_t)n, Seed );
+    *xc = PhiloxRanf( u.v[0], XCMIN, XCMAX );
+    *yc = PhiloxRanf( u.v[1], YCMIN, YCMAX );
+    *r  = PhiloxRanf( u.v[2],  RMIN,  RMAX );
+}
+
+// one thread's count of each case, on a cache line of its own:
+struct CaseCounts
+{
+    long long n[BOUNCE_NUMCASES];
+} __attribute__((aligned(CACHELINE)));
+
+// the packed counts into the totals:
+static inline void
+CasesUnpack( uint64_t &packed, long long total[BOUNCE_NUMCASES] )
+{
+    for( int c = 0; c < BOUNCE_NUMCASES; c++ )
+        total[c] += (long long)( ( packed >> ( CASEPACKBITS * c ) ) & CASEPACKTRIALS );
+    packed = 0;
+}
+
+// one outcome into the packed counts: one shift and one add, about what counting the hits costs:
+static inline void
+CountCase( int c, uint64_t &packed, int &left, long long total[BOUNCE_NUMCASES] )
+{
+    packed += (uint64_t)1 << ( CASEPACKBITS * c );
+    if( --left == 0 )
+    {
+        CasesUnpack( packed, total );
+        left = CASEPACKTRIALS;
+    }
+}
+
+// trials first ... end-1 of this thread's share through BounceCase( ):
+static inline void
+CasesScalar( int rng, const float *xcs, const float *ycs, const float *rs, long long first, long long end,
+             long long total[BOUNCE_NUMCASES] )
+{
+    uint64_t packed = 0;
+    int left = CASEPACKTRIALS;
+    if( rng == RNG_PHILOX )
+    {
+        #pragma omp for
+        for( long long n = first; n < end; n++ )
+        {
+            float xc, yc, r;
+            PhiloxCircle( n, &xc, &yc, &r );
+            CountCase( BounceCase<float, float>( xc, yc, r ), packed, left, total );
+        }
+    }
+    else
+    {
+        #pragma omp for
+        for( long long n = first; n < end; n++ )
+            CountCase( BounceCase<float, float>( xcs[n], ycs[n], rs[n] ), packed, left, total );
+    }
+    CasesUnpack( packed, total );
+}
+
+// all the trials through the -k kernel; each thread counts in registers and leaves its
+// totals in counts[its thread number]; the SIMD kernel counts the lanes past case A, past
+// case B and hitting the plate, and the four cases are the differences:
+void
+TrialsCases( int kernel, int rng, const float *xcs, const float *ycs, const float *rs, CaseCounts *counts )
+{
+    const long long numBlocks = kernel == KERNEL_SIMD ? NUMTRIALS / BOUNCE_LANES : 0;
+
+    #pragma omp parallel default(none) shared(kernel,rng,xcs,ycs,rs,counts,numBlocks)
+    {
+        long long total[BOUNCE_NUMCASES] = { 0, 0, 0, 0 };
+        long long lanes = 0, pastA = 0, pastB = 0, hit = 0;
+
+        if( rng == RNG_PHILOX )
+        {
+            #pragma omp for
+            for( long long blk = 0; blk < numBlocks; blk++ )
+            {
+                float xc[BOUNCE_LANES], yc[BOUNCE_LANES], r[BOUNCE_LANES];
+                for( int lane = 0; lane < BOUNCE_LANES; lane++ )
+                    PhiloxCircle( blk*BOUNCE_LANES + lane, &xc[lane], &yc[lane], &r[lane] );
+                vmask a, b;
+                vmask h = BounceCaseMasks( xc, yc, r, &a, &b );
+                lanes += BOUNCE_LANES;
+                pastA += VCOUNT( a );
+                pastB += VCOUNT( b );
+                hit   += VCOUNT( h );
+            }
+        }
+        else
+        {
+            #pragma omp for
+            for( long long blk = 0; blk < numBlocks; blk++ )
+            {
+                long long n = blk*BOUNCE_LANES;
+                vmask a, b;
+                vmask h = BounceCaseMasks( &xcs[n], &ycs[n], &rs[n], &a, &b );
+                lanes += BOUNCE_LANES;
+                pastA += VCOUNT( a );
+                pastB += VCOUNT( b );
+                hit   += VCOUNT( h );
+            }
+        }
+        total[BOUNCE_MISSED]   += lanes - pastA;
+        total[BOUNCE_ENGULFED] += pastA - pastB;
+        total[BOUNCE_UP]       += pastB - hit;
+        total[BOUNCE_HIT]      += hit;
+
+        // every trial of the scalar kernel, or the SIMD kernel's leftovers:
+        CasesScalar( rng, xcs, ycs, rs, numBlocks*BOUNCE_LANES, NUMTRIALS, total );
+
+        CaseCounts *mine = &counts[omp_get_thread_num( )];
+        for( int c = 0; c < BOUNCE_NUMCASES; c++ )
+            mine->n[c] = total[c];
+    }
+}
+
+// trials first ... first+count-1 through the scalar Bounce( ):
+long long
+TrialsScalar( int rng, const float *xcs, const float *ycs, const float *rs, long long first, long long count )
+{
+    const long long end = first + count;
+    long long numHits = 0;
+    if( rng == RNG_PHILOX )
+    {
+        #pragma omp parallel for default(none) shared(first,end) reduction(+:numHits)
+        for( long long n = first; n < end; n++ )
+        {
+            // randomize the location and radius of the circle:
+            float xc, yc, r;
+            PhiloxCircle( n, &xc, &yc, &r );
+            numHits += Bounce( xc, yc, r );
+        }
+    }
+    else
+    {
+        #pragma omp parallel for default(none) shared(xcs,ycs,rs,first,end) reduction(+:numHits)
+        for( long long n = first; n < end; n++ )
+        {
+            // randomize the location and radius of the circle:
+            numHits += Bounce( xcs[n], ycs[n], rs[n] );
+        }
+    }
+    return numHits;
+}
+
+// the same trials through BounceLanes( ), BOUNCE_LANES at a time, with the leftovers through Bounce( ):
+long long
+TrialsSimd( int rng, const float *xcs, const float *ycs, const float *rs, long long first, long long count )
+{
+    const long long numBlocks = count / BOUNCE_LANES;
+    const long long end = first + count;
+    long long numHits = 0;
+    if( rng == RNG_PHILOX )
+    {
+        #pragma omp parallel for default(none) shared(first,numBlocks) reduction(+:numHits)
+        for( long long blk = 0; blk < numBlocks; blk++ )
+        {
+            float xc[BOUNCE_LANES], yc[BOUNCE_LANES], r[BOUNCE_LANES];
+            for( int lane = 0; lane < BOUNCE_LANES; lane++ )
+                PhiloxCircle( first + blk*BOUNCE_LANES + lane, &xc[lane], &yc[lane], &r[lane] );
+            numHits += BounceLanes( xc, yc, r );
+        }
+        for( long long n = first + numBlocks*BOUNCE_LANES; n < end; n++ )
+        {
+            float xc, yc, r;
+            PhiloxCircle( n, &xc, &yc, &r );
+            numHits += Bounce( xc, yc, r );
+        }
+    }
+    else
+    {
+        #pragma omp parallel for default(none) shared(xcs,ycs,rs,first,numBlocks) reduction(+:numHits)
+        for( long long blk = 0; blk < numBlocks; blk++ )
+        {
+            long long n = first + blk*BOUNCE_LANES;
+            numHits += BounceLanes( &xcs[n], &ycs[n], &rs[n] );
+        }
+        for( long long n = first + numBlocks*BOUNCE_LANES; n < end; n++ )
+            numHits += Bounce( xcs[n], ycs[n], rs[n] );
+    }
+    return numHits;
+}
+
+// run Philox trials in batches until the 95% CI half-width of the hit probability reaches target:
+int
+Adaptive( int kernel, double target, long long batch, long long maxTrials )
+{
+    double time0 = omp_get_wtime( );
+    long long trials = 0;
+    long long hits = 0;
+    int batches = 0;
+    double p = 0.;
+    double half = HUGE_VAL;
+    long long count = batch;
+
+    fprintf( stderr, "Batch\tTrials\tProbability\tHalf-width\n" );
+    while( trials < maxTrials )
+    {
+        if( count > maxTrials - trials )
+            count = maxTrials - trials;
+        if( kernel == KERNEL_SIMD )
+            hits += TrialsSimd( RNG_PHILOX, NULL, NULL, NULL, trials, count );
+        else
+            hits += TrialsScalar( RNG_PHILOX, NULL, NULL, NULL, trials, count );
+        trials += count;
+        batches++;
+
+        // each trial is a 0/1 sample, so the running (unbiased) variance follows from the two counts:
+        p = (double)hits / (double)trials;
+        double variance = trials > 1 ? (double)trials / (double)( trials - 1 ) * p * ( 1. - p ) : 0.;
+        half = Z95 * sqrt( variance / (double)trials );
+        fprintf( stderr, "%d\t%lld\t%.6lf\t%.3e\n", batches, trials, p, half );
+
+        // an all-miss or all-hit start has zero variance and says nothing about the precision yet:
+        if( batches >= ADAPTIVEMINBATCHES && hits > 0 && hits < trials && half <= target )
+            break;
+
+        // the half-width shrinks as 1/sqrt(trials), so jump straight to the predicted total
+        // (never less than one batch, so a noisy early estimate cannot stall the loop):
+        count = batch;
+        if( hits > 0 && hits < trials )
+        {
+            double needed = (double)trials * ( half / target ) * ( half / target ) - (double)trials;
+            if( needed > (double)count )
+                count = needed < (double)maxTrials ? (long long)needed : maxTrials;
+        }
+    }
+    double seconds = omp_get_wtime( ) - time0;
+    double megaTrialsPerSecond = (double)trials / seconds / 1000000.;
+
+    // all misses or all hits up to maxTrials give a zero half-width but no precision either:
+    int reached = hits > 0 && hits < trials && half <= target;
+
+    printf("Kernel: %s\n", kernel == KERNEL_SIMD ? "simd" : "scalar");
+    printf("RNG: philox, seed %llu\n", (unsigned long long)Seed);
+    printf("Target half-width: %.3e (95%% CI)%s\n", target, reached ? "" : " NOT reached");
+    printf("Num threads: %8i\nTrials used: %lld in %d batches (at least %lld each)\n", NUMT, trials, batches, batch);
+    printf("Hit probability: %.6lf +- %.3e  [%.6lf, %.6lf]\n", p, half, p - half, p + half);
+    printf("Time to precision: %.3lf sec\nMegaTrials/Sec: %8.2lf\n", seconds, megaTrialsPerSecond);
+    printf("%i\t%lld\t%.6lf\t%.3e\t%.3lf\t%8.2lf\n", NUMT, trials, p, half, seconds, megaTrialsPerSecond);
+    return reached ? 0 : 1;
+}
+
+#ifdef USE_MPI
+// this rank's share of the trials, its hits, and the sum of every rank's hits on rank 0:
+struct RankRun
+{
+    int       kernel;
+    long long first;
+    long long count;
+    long long numHits;
+    long long totalHits;
+};
+
+void
+RunRankTrials( void *arg )
+{
+    RankRun *run = (RankRun *)arg;
+    if( run->kernel == KERNEL_SIMD )
+        run->numHits = TrialsSimd( RNG_PHILOX, NULL, NULL, NULL, run->first, run->count );
+    else
+        run->numHits = TrialsScalar( RNG_PHILOX, NULL, NULL, NULL, run->first, run->count );
+}
+
+void
+RunReduce( void *arg )
+{
+    RankRun *run = (RankRun *)arg;
+    MPI_Reduce( &run->numHits, &run->totalHits, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD );
+}
+
+// one whole distributed pass: line the ranks up, run every share, and merge the hits:
+void
+RunDistributed( void *arg )
+{
+    MPI_Barrier( MPI_COMM_WORLD );
+    RunRankTrials( arg );
+    RunReduce( arg );
+}
+
+// split the trials across the ranks and report per-rank rates, the reduction, and the aggregate:
+int
+Distributed( int kernel )
+{
+    int rank, size;
+    MPI_Comm_rank( MPI_COMM_WORLD, &rank );
+    MPI_Comm_size( MPI_COMM_WORLD, &size );
+
+    long long q = NUMTRIALS / size;
+    long long rem = NUMTRIALS % size;
+    struct RankRun run;
+    run.kernel = kernel;
+    run.first = (long long)rank * q + ( rank < rem ? rank : rem );
+    run.count = q + ( rank < rem ? 1 : 0 );
+    run.numHits = run.totalHits = 0;
+
+    // the local kernel has no collectives, so each rank may stop sampling on its own:
+    struct BenchConfig config = BENCH_DEFAULTS;
+    struct BenchStats local;
+    BenchRun( &config, RunRankTrials, &run, &local );
+
+    // the collective steps take the same number of samples everywhere:
+    struct BenchConfig fixed = BENCH_DEFAULTS;
+    fixed.minRuns = fixed.maxRuns = MPIRUNS;
+    fixed.maxSeconds = HUGE_VAL;
+    fixed.targetCI = -1.;
+    struct BenchStats reduce, whole;
+    MPI_Barrier( MPI_COMM_WORLD );
+    BenchRun( &fixed, RunReduce, &run, &reduce );
+    BenchRun( &fixed, RunDistributed, &run, &whole );
+
+    double mine[3] = { (double)run.count, (double)run.count / local.median / 1000000., BenchCIPercent( &local ) };
+    char name[MPI_MAX_PROCESSOR_NAME] = "";
+    int nameLength;
+    MPI_Get_processor_name( name, &nameLength );
+
+    double *all = rank == 0 ? new double [3*size] : NULL;
+    char *names = rank == 0 ? new char [MPI_MAX_PROCESSOR_NAME*size] : NULL;
+    MPI_Gather( mine, 3, MPI_DOUBLE, all, 3, MPI_DOUBLE, 0, MPI_COMM_WORLD );
+    MPI_Gather( name, MPI_MAX_PROCESSOR_NAME, MPI_CHAR, names, MPI_MAX_PROCESSOR_NAME, MPI_CHAR, 0, MPI_COMM_WORLD );
+
+    if( rank == 0 )
+    {
+        float currentProb = (float)run.totalHits/(float)NUMTRIALS;
+        double megaTrialsPerSecond = (double)NUMTRIALS / whole.median / 1000000.;
+
+        printf("Kernel: %s\n", kernel == KERNEL_SIMD ? "simd" : "scalar");
+        printf("RNG: philox, seed %llu, one counter range per rank\n", (unsigned long long)Seed);
+        printf("Ranks: %d x %d threads\n", size, NUMT);
+        printf("Rank\tHost\tTrials\tMedian MegaTrials/Sec\tCI +-%%\n");
+        for( int r = 0; r < size; r++ )
+            printf("%d\t%s\t%.0lf\t%8.2lf\t%6.2lf\n", r, &names[r*MPI_MAX_PROCESSOR_NAME], all[3*r], all[3*r+1], all[3*r+2]);
+        printf("Reduction: %8.2lf usec median (p95 %.2lf)\n", reduce.median*1.e6, reduce.p95*1.e6);
+        printf("Distributed pass: %8.2lf usec median (barrier + trials + reduction)\n", whole.median*1.e6);
+        printf("Num trials: %8lld\nHits: %8lld\nHit probability: %8.2lf\nMegaTrials/Sec: %8.2lf\n", (long long)NUMTRIALS, run.totalHits, currentProb, megaTrialsPerSecond);
+        printf("%i\t%i\t%lld\t%8.2lf\t%8.2lf\t%8.2lf\n", size, NUMT, (long long)NUMTRIALS, currentProb, megaTrialsPerSecond, reduce.median*1.e6);
+        delete [] all;
+        delete [] names;
+    }
+    return 0;
+}
+#endif
+
+// set by SIGINT or SIGTERM; a checkpointed run stops at the end of the current epoch:
+static volatile sig_atomic_t StopRequested = 0;
+
+static void
+RequestStop( int )
+{
+    StopRequested = 1;
+}
+
+// run the chunks in epochs, checkpointing to path; with resume, start from the checkpoint in path:
+int
+Checkpointed( int kernel, const char *path, int resume, double interval )
+{
+    struct Checkpoint ck;
+    memset( &ck, 0, sizeof(ck) );
+    ck.seed = Seed;
+    ck.numTrials = NUMTRIALS;
+    ck.chunkTrials = CHUNKTRIALS;
+    if( resume )
+    {
+        struct Checkpoint saved;
+        if( !CheckpointRead( path, &saved ) )
+        {
+            fprintf( stderr, "No valid checkpoint in '%s'\n", path );
+            return 1;
+        }
+        if( saved.seed != ck.seed || saved.numTrials != ck.numTrials || saved.chunkTrials != ck.chunkTrials )
+        {
+            fprintf( stderr, "'%s' is a run of seed %llu, %lld trials in chunks of %lld, not seed %llu, %lld trials in chunks of %d\n",
+                path, (unsigned long long)saved.seed, (long long)saved.numTrials, (long long)saved.chunkTrials,
+                (unsigned long long)Seed, (long long)NUMTRIALS, CHUNKTRIALS );
+            return 1;
+        }
+        ck = saved;
+    }
+    const long long resumedAt = (long long)ck.nextChunk;
+
+    signal( SIGINT, RequestStop );
+    signal( SIGTERM, RequestStop );
+
+    const double previousSeconds = ck.seconds;
+    double time0 = omp_get_wtime( );
+    double lastWrite = time0;
+    double writeSeconds = 0.;
+    int writes = 0;
+    while( ck.nextChunk < NUMCHUNKS && !StopRequested )
+    {
+        long long count = NUMCHUNKS - ck.nextChunk < CHECKPOINTEPOCH ? NUMCHUNKS - ck.nextChunk : CHECKPOINTEPOCH;
+        ck.numHits += TrialsChunked( kernel, ck.nextChunk, count );
+        ck.nextChunk += count;
+
+        double now = omp_get_wtime( );
+        ck.seconds = previousSeconds + ( now - time0 );
+        if( now - lastWrite >= interval || ck.nextChunk == NUMCHUNKS || StopRequested )
+        {
+            if( !CheckpointWrite( path, &ck ) )
+                fprintf( stderr, "Cannot write checkpoint '%s'\n", path );
+            lastWrite = omp_get_wtime( );
+            writeSeconds += lastWrite - now;
+            writes++;
+        }
+    }
+    double seconds = omp_get_wtime( ) - time0;
+
+    const long long nextChunk = (long long)ck.nextChunk;
+    long long trialsDone = nextChunk * CHUNKTRIALS < NUMTRIALS ? nextChunk * CHUNKTRIALS : NUMTRIALS;
+    long long sessionTrials = trialsDone - ( resumedAt * CHUNKTRIALS < NUMTRIALS ? resumedAt * CHUNKTRIALS : NUMTRIALS );
+    printf("RNG: chunked, seed %llu, %lld chunks of %d\n", (unsigned long long)Seed, NUMCHUNKS, CHUNKTRIALS);
+    printf("Checkpoint: %s, %d written this session (%.3lf msec in all)\n", path, writes, writeSeconds*1000.);
+    if( nextChunk > resumedAt )
+        printf("Chunks: %lld - %lld this session in %.3lf sec, MegaTrials/Sec: %8.2lf\n",
+            resumedAt, nextChunk - 1, seconds, (double)sessionTrials / seconds / 1000000.);
+    printf("Chunks done: %lld of %lld\n", nextChunk, NUMCHUNKS);
+    if( ck.nextChunk < NUMCHUNKS )
+    {
+        printf("Stopped after %lld of %lld trials; continue with -R %s\n", trialsDone, (long long)NUMTRIALS, path);
+        return 2;
+    }
+    printf("Num trials: %8lld\nHits: %8lld\nHit probability: %8.4lf\nTotal run time: %.3lf sec\n",
+        (long long)NUMTRIALS, (long long)ck.numHits, (double)ck.numHits / (double)NUMTRIALS, ck.seconds);
+    return 0;
+}
+
+// the hits in one chunk of the chunked mode; the chunk's stream is drawn in trial order
+// (xc, yc, r for each trial), so both kernels see exactly the same circles, and decide
+// every one of them the same way:
+long long
+ChunkHits( int kernel, long long chunk )
+{
+    long long first = chunk * CHUNKTRIALS;
+    int count = NUMTRIALS - first < CHUNKTRIALS ? (int)( NUMTRIALS - first ) : CHUNKTRIALS;
+    Xoshiro128 g = XoshiroChunk( Seed, (uint64_t)chunk );
+
+    long long numHits = 0;
+    int n = 0;
+    if( kernel == KERNEL_SIMD )
+    {
+        for( ; n + BOUNCE_LANES <= count; n += BOUNCE_LANES )
+        {
+            float xc[BOUNCE_LANES], yc[BOUNCE_LANES], r[BOUNCE_LANES];
+            for( int lane = 0; lane < BOUNCE_LANES; lane++ )
+            {
+                xc[lane] = XoshiroRanf( &g, XCMIN, XCMAX );
+                yc[lane] = XoshiroRanf( &g, YCMIN, YCMAX );
+                 r[lane] = XoshiroRanf( &g,  RMIN,  RMAX );
+            }
+            numHits += BounceLanes( xc, yc, r );
+        }
+    }
+    for( ; n < count; n++ )
+    {
+        float xc = XoshiroRanf( &g, XCMIN, XCMAX );
+        float yc = XoshiroRanf( &g, YCMIN, YCMAX );
+        float  r = XoshiroRanf( &g,  RMIN,  RMAX );
+        numHits += Bounce( xc, yc, r );
+    }
+    return numHits;
+}
+
+// chunks first ... first+count-1, in whatever order the threads pick them up:
+long long
+TrialsChunked( int kernel, long long first, long long count )
+{
+    const long long end = first + count;
+    long long numHits = 0;
+    #pragma omp parallel for default(none) shared(kernel,first,end) schedule(dynamic) reduction(+:numHits)
+    for( long long chunk = first; chunk < end; chunk++ )
+        numHits += ChunkHits( kernel, chunk );
+    return numHits;
+}
+
+// the hits among the nEff trials of one replicate of a sampling design:
+long long
+SampleHits( int kernel, const struct SampleDesign *d )
+{
+    const long long nEff = d->nEff;
+    const long long numBlocks = kernel == KERNEL_SIMD ? nEff / BOUNCE_LANES : 0;
+    long long numHits = 0;
+
+    #pragma omp parallel for default(none) shared(d,numBlocks) reduction(+:numHits)
+    for( long long blk = 0; blk < numBlocks; blk++ )
+    {
+        float xc[BOUNCE_LANES], yc[BOUNCE_LANES], r[BOUNCE_LANES];
+        for( int lane = 0; lane < BOUNCE_LANES; lane++ )
+        {
+            double u[3];
+            SamplePoint( d, blk*BOUNCE_LANES + lane, u );
+            xc[lane] = XCMIN + (float)u[0] * ( XCMAX - XCMIN );
+            yc[lane] = YCMIN + (float)u[1] * ( YCMAX - YCMIN );
+             r[lane] =  RMIN + (float)u[2] * (  RMAX -  RMIN );
+        }
+        numHits += BounceLanes( xc, yc, r );
+    }
+
+    #pragma omp parallel for default(none) shared(d,numBlocks,nEff) reduction(+:numHits)
+    for( long long n = numBlocks*BOUNCE_LANES; n < nEff; n++ )
+    {
+        double u[3];
+        SamplePoint( d, n, u );
+        numHits += Bounce( XCMIN + (float)u[0] * ( XCMAX - XCMIN ),
+                           YCMIN + (float)u[1] * ( YCMAX - YCMIN ),
+                            RMIN + (float)u[2] * (  RMAX -  RMIN ) );
+    }
+    return numHits;
+}
+
+// run replicates of one sampling design (or of all of them) and compare their variance to plain Monte Carlo:
+int
+VarianceReduction( int kernel, int sampling, int replicates )
+{
+    long long n = NUMTRIALS / replicates;
+
+    printf("Kernel: %s\nSeed: %llu\nNum threads: %8i\n", kernel == KERNEL_SIMD ? "simd" : "scalar", (unsigned long long)Seed, NUMT);
+    printf("Sampling\tTrials/replicate\tReplicates\tHit probability\tStd error\tVRF\tPlain-equivalent trials\tMegaTrials/Sec\n");
+    for( int mode = 0; mode < SAMPLE_NUMMODES; mode++ )
+    {
+        if( sampling != SAMPLE_NUMMODES && mode != sampling )
+            continue;
+
+        double sum = 0., sumSq = 0.;
+        long long nEff = n;
+        double seconds = 0.;
+        for( int rep = 0; rep < replicates; rep++ )
+        {
+            struct SampleDesign d;
+            if( !SampleDesignInit( &d, mode, n, (uint32_t)rep, Seed ) )
+            {
+                fprintf( stderr, "Cannot allocate the Latin hypercube permutations\n" );
+                SampleDesignFree( &d );
+                return 1;
+            }
+            double time0 = omp_get_wtime( );
+            long long hits = SampleHits( kernel, &d );
+            seconds += omp_get_wtime( ) - time0;
+
+            double estimate = (double)hits / (double)d.nEff;
+            sum += estimate;
+            sumSq += estimate * estimate;
+            nEff = d.nEff;
+            SampleDesignFree( &d );
+        }
+
+        // the spread of the replicate estimates is the variance of one replicate's estimate:
+        double p = sum / (double)replicates;
+        double variance = fmax( sumSq - sum * p, 0. ) / (double)( replicates - 1 );
+        double plainVariance = p * ( 1. - p ) / (double)nEff;
+        double vrf = variance > 0. ? plainVariance / variance : HUGE_VAL;
+
+        printf("%s\t%lld\t%d\t%.6lf\t%.3e\t%8.2lf\t%.0lf\t%8.2lf\n",
+            SamplingName( mode ), nEff, replicates, p, sqrt( variance / (double)replicates ), vrf,
+            vrf * (double)nEff, (double)nEff * (double)replicates / seconds / 1000000.);
+    }
+    return 0;
+}
+
+// the hits among the first n (a power of 2) points of one scrambled Sobol replicate; each
+// thread jumps straight to its own block of Gray-code positions and steps through it:
+long long
+QmcHits( int kernel, const struct Sobol *sob, long long n, const uint32_t seeds[SOBOL_DIMS] )
+{
+    long long numHits = 0;
+    #pragma omp parallel default(none) shared(kernel,sob,n,seeds) reduction(+:numHits)
+    {
+        long long numThreads = omp_get_num_threads( );
+        long long me = omp_get_thread_num( );
+        long long lo = n * me / numThreads;
+        long long hi = n * ( me + 1 ) / numThreads;
+
+        uint32_t x[SOBOL_DIMS];
+        if( lo < hi )
+            SobolPoint( sob, (uint32_t)lo, x );
+
+        long long i = lo;
+        if( kernel == KERNEL_SIMD )
+        {
+            for( ; i + BOUNCE_LANES <= hi; i += BOUNCE_LANES )
+            {
+                float xc[BOUNCE_LANES], yc[BOUNCE_LANES], r[BOUNCE_LANES];
+                for( int lane = 0; lane < BOUNCE_LANES; lane++ )
+                {
+                    xc[lane] = XCMIN + (float)SampleUnit( SobolScramble( x[0], seeds[0] ) ) * ( XCMAX - XCMIN );
+                    yc[lane] = YCMIN + (float)SampleUnit( SobolScramble( x[1], seeds[1] ) ) * ( YCMAX - YCMIN );
+                     r[lane] =  RMIN + (float)SampleUnit( SobolScramble( x[2], seeds[2] ) ) * (  RMAX -  RMIN );
+                    SobolNext( sob, (uint32_t)( i + lane ), x );
+                }
+                numHits += BounceLanes( xc, yc, r );
+            }
+        }
+        for( ; i < hi; i++ )
+        {
+            numHits += Bounce( XCMIN + (float)SampleUnit( SobolScramble( x[0], seeds[0] ) ) * ( XCMAX - XCMIN ),
+                               YCMIN + (float)SampleUnit( SobolScramble( x[1], seeds[1] ) ) * ( YCMAX - YCMIN ),
+                                RMIN + (float)SampleUnit( SobolScramble( x[2], seeds[2] ) ) * (  RMAX -  RMIN ) );
+            SobolNext( sob, (uint32_t)i, x );
+        }
+    }
+    return numHits;
+}
+
+// standard error against trial count for scrambled Sobol and for plain Monte Carlo:
+int
+QmcConvergence( int kernel, int replicates )
+{
+    struct Sobol sob;
+    SobolInit( &sob );
+
+    printf("Kernel: %s\nSeed: %llu\nNum threads: %8i\nReplicates: %8i\n", kernel == KERNEL_SIMD ? "simd" : "scalar", (unsigned long long)Seed, NUMT, replicates);
+    printf("Trials\tQMC probability\tQMC std error\tMC probability\tMC std error\tMC/QMC error\tQMC MegaTrials/Sec\tMC MegaTrials/Sec\n");
+
+    // least-squares slopes of log(error) against log(trials): -0.5 for MC; scrambled Sobol reaches
+    // -1.5 on smooth integrands, but about -0.5 - 1/(2*3) on this hit/miss (discontinuous) one:
+    double sumX = 0., sumXX = 0., sumQ = 0., sumXQ = 0., sumM = 0., sumXM = 0.;
+    int numPoints = 0;
+    for( long long n = QMCMINTRIALS; n <= NUMTRIALS && n <= ( 1LL << 32 ); n *= 2 )
+    {
+        double qSum = 0., qSumSq = 0., mSum = 0., mSumSq = 0.;
+        double qSeconds = 0., mSeconds = 0.;
+        for( int rep = 0; rep < replicates; rep++ )
+        {
+            uint32_t seeds[SOBOL_DIMS];
+            SobolSeeds( Seed, (uint32_t)rep, seeds );
+            double time0 = omp_get_wtime( );
+            double q = (double)QmcHits( kernel, &sob, n, seeds ) / (double)n;
+            qSeconds += omp_get_wtime( ) - time0;
+
+            struct SampleDesign d;
+            SampleDesignInit( &d, SAMPLE_PLAIN, n, (uint32_t)rep, Seed );
+            time0 = omp_get_wtime( );
+            double m = (double)SampleHits( kernel, &d ) / (double)n;
+            mSeconds += omp_get_wtime( ) - time0;
+            SampleDesignFree( &d );
+
+            qSum += q;  qSumSq += q*q;
+            mSum += m;  mSumSq += m*m;
+        }
+
+        // the error of one replicate's estimate, from the spread across replicates:
+        double qMean = qSum / (double)replicates;
+        double mMean = mSum / (double)replicates;
+        double qErr = sqrt( fmax( qSumSq - qSum * qMean, 0. ) / (double)( replicates - 1 ) );
+        double mErr = sqrt( fmax( mSumSq - mSum * mMean, 0. ) / (double)( replicates - 1 ) );
+
+        printf("%lld\t%.6lf\t%.3e\t%.6lf\t%.3e\t%8.2lf\t%8.2lf\t%8.2lf\n",
+            n, qMean, qErr, mMean, mErr, qErr > 0. ? mErr / qErr : HUGE_VAL,
+            (double)n * replicates / qSeconds / 1000000., (double)n * replicates / mSeconds / 1000000.);
+
+        if( qErr > 0. && mErr > 0. )
+        {
+            double x = log( (double)n );
+            sumX += x;  sumXX += x*x;
+            sumQ += log( qErr );  sumXQ += x * log( qErr );
+            sumM += log( mErr );  sumXM += x * log( mErr );
+            numPoints++;
+        }
+    }
+
+    if( numPoints >= 2 )
+    {
+        double den = numPoints * sumXX - sumX * sumX;
+        printf("Convergence: QMC error ~ N^%.2lf, MC error ~ N^%.2lf\n",
+            ( numPoints * sumXQ - sumX * sumQ ) / den, ( numPoints * sumXM - sumX * sumM ) / den);
+    }
+    return 0;
+}
+
+// one geometry of the parameter sweep:
+struct SweepConfig
+{
+    float xcmin, xcmax;
+    float ycmin, ycmax;
+    float rmin, rmax;
+};
+
+// read the configurations, one per line of exactly six numbers after the comments are
+// stripped, skipping blank lines; returns how many and sets *configs, or reports what is
+// wrong and returns -1 (with nothing left allocated):
+int
+ReadSweep( const char *path, SweepConfig **configs )
+{
+    FILE *fp = strcmp( path, "-" ) == 0 ? stdin : fopen( path, "r" );
+    if( fp == NULL )
+    {
+        fprintf( stderr, "Cannot open '%s'\n", path );
+        return -1;
+    }
+
+    int num = 0, max = 0;
+    *configs = NULL;
+    char line[512];
+    for( int lineNum = 1; fgets( line, sizeof(line), fp ) != NULL; lineNum++ )
+    {
+        if( strchr( line, '\n' ) == NULL && !feof( fp ) )
+        {
+            fprintf( stderr, "%s:%d: line longer than %d characters\n", path, lineNum, (int)sizeof(line) - 2 );
+            num = -1;
+            break;
+        }
+        char *hash = strchr( line, '#' );
+        if( hash != NULL )
+            *hash = '\0';
+        char *first = line;
+        while( isspace( (unsigned char)*first ) )
+            first++;
+        if( *first == '\0' )
+            continue;                       // blank or comment
+        SweepConfig c;
+        int used = 0;
+        int got = sscanf( first, "%f %f %f %f %f %f %n", &c.xcmin, &c.xcmax, &c.ycmin, &c.ycmax, &c.rmin, &c.rmax, &used );
+        if( got != 6 || first[used] != '\0' )
+        {
+            fprintf( stderr, "%s:%d: expected XCMIN XCMAX YCMIN YCMAX RMIN RMAX and nothing else\n", path, lineNum );
+            num = -1;
+            break;
+        }
+        if( num == max )
+        {
+            max = max == 0 ? 64 : 2*max;
+            SweepConfig *grown = (SweepConfig *)realloc( *configs, max * sizeof(SweepConfig) );
+            if( grown == NULL )
+            {
+                fprintf( stderr, "Out of memory at configuration %d\n", num );
+                num = -1;
+                break;
+            }
+            *configs = grown;
+        }
+        (*configs)[num++] = c;
+    }
+    if( fp != stdin )
+        fclose( fp );
+    if( num < 0 )
+    {
+        free( *configs );
+        *configs = NULL;
+    }
+    return num;
+}
+
+// evaluate every configuration over the same NUMTRIALS points and print the probability table:
+int
+Sweep( int kernel, const char *path )
+{
+    SweepConfig *configs;
+    int numConfigs = ReadSweep( path, &configs );
+    if( numConfigs < 0 )
+        return 1;
+    if( numConfigs == 0 )
+    {
+        fprintf( stderr, "No configurations in '%s'\n", path );
+        return 1;
+    }
+
+    const long long numChunks = ( (long long)NUMTRIALS + SWEEPCHUNK - 1 ) / SWEEPCHUNK;
+    const long long numBlocks = ( numConfigs + SWEEPBLOCK - 1 ) / SWEEPBLOCK;
+    const long long numItems = numChunks * numBlocks;
+    long long *hits = new long long [numConfigs];
+    for( int c = 0; c < numConfigs; c++ )
+        hits[c] = 0;
+
+    double time0 = omp_get_wtime( );
+    #pragma omp parallel default(none) shared(kernel,configs,numConfigs,numChunks,numItems,hits,Seed)
+    {
+        // this thread's unit-cube points and one configuration's circles, reused for every item:
+        float *u = new float [3*SWEEPCHUNK];
+        float *xc = new float [SWEEPCHUNK];
+        float *yc = new float [SWEEPCHUNK];
+        float *r  = new float [SWEEPCHUNK];
+
+        #pragma omp for schedule(dynamic)
+        for( long long item = 0; item < numItems; item++ )
+        {
+            long long chunk = item % numChunks;
+            int firstConfig = (int)( item / numChunks ) * SWEEPBLOCK;
+            int lastConfig = firstConfig + SWEEPBLOCK < numConfigs ? firstConfig + SWEEPBLOCK : numConfigs;
+            int count = NUMTRIALS - chunk*SWEEPCHUNK < SWEEPCHUNK ? (int)( NUMTRIALS - chunk*SWEEPCHUNK ) : SWEEPCHUNK;
+
+            // the chunk's points, drawn once for the whole block of configurations:
+            Xoshiro128 g = XoshiroChunk( Seed, (uint64_t)chunk );
+            for( int n = 0; n < 3*count; n++ )
+                u[n] = XoshiroRanf( &g, 0.f, 1.f );
+
+            for( int c = firstConfig; c < lastConfig; c++ )
+            {
+                const SweepConfig *cf = &configs[c];
+                for( int n = 0; n < count; n++ )
+                {
+                    xc[n] = cf->xcmin + u[3*n  ] * ( cf->xcmax - cf->xcmin );
+                    yc[n] = cf->ycmin + u[3*n+1] * ( cf->ycmax - cf->ycmin );
+                     r[n] = cf->rmin  + u[3*n+2] * ( cf->rmax  - cf->rmin  );
+                }
+
+                long long numHits = 0;
+                int n = 0;
+                if( kernel == KERNEL_SIMD )
+                    for( ; n + BOUNCE_LANES <= count; n += BOUNCE_LANES )
+                        numHits += BounceLanes( &xc[n], &yc[n], &r[n] );
+                for( ; n < count; n++ )
+                    numHits += Bounce( xc[n], yc[n], r[n] );
+
+                #pragma omp atomic
+                hits[c] += numHits;
+            }
+        }
+
+        delete [] u;
+        delete [] xc;
+        delete [] yc;
+        delete [] r;
+    }
+    double seconds = omp_get_wtime( ) - time0;
+
+    printf("Config\tXCMIN\tXCMAX\tYCMIN\tYCMAX\tRMIN\tRMAX\tTrials\tHit probability\tCI low\tCI high\n");
+    for( int c = 0; c < numConfigs; c++ )
+    {
+        const SweepConfig *cf = &configs[c];
+        double p = (double)hits[c] / (double)NUMTRIALS;
+        double half = Z95 * sqrt( p * ( 1. - p ) / (double)NUMTRIALS );
+        printf("%d\t%g\t%g\t%g\t%g\t%g\t%g\t%lld\t%.6lf\t%.6lf\t%.6lf\n", c,
+            cf->xcmin, cf->xcmax, cf->ycmin, cf->ycmax, cf->rmin, cf->rmax, (long long)NUMTRIALS, p, p - half, p + half);
+    }
+    fprintf( stderr, "%d configurations x %lld trials in %lld work items on %d threads: %.3lf sec, %.2lf MegaTrials/Sec\n",
+        numConfigs, (long long)NUMTRIALS, numItems, NUMT, seconds, (double)numConfigs * (double)NUMTRIALS / seconds / 1000000. );
+
+    delete [] hits;
+    free( configs );
+    return 0;
+}
+
+// the circle of trial n in the precision comparison: the three words become doubles with
+// 32 bits of resolution, which the float variants then round to 24:
+template <typename Store>
+static inline void
+PrecisionCircle( long long n, Store *xc, Store *yc, Store *r )
+{
+    const double SCALE = 1. / 4294967296.;
+    Philox4 u = PhiloxTrial( (uint64_t)n, Seed );
+    *xc = (Store)( (double)XCMIN + (double)u.v[0] * SCALE * (double)( XCMAX - XCMIN ) );
+    *yc = (Store)( (double)YCMIN + (double)u.v[1] * SCALE * (double)( YCMAX - YCMIN ) );
+    *r  = (Store)( (double)RMIN  + (double)u.v[2] * SCALE * (double)( RMAX  - RMIN  ) );
+}
+
+// the hits of all the trials with the circle stored as Store and the math done in Calc:
+template <typename Store, typename Calc>
+long long
+PrecisionHits( )
+{
+    long long numHits = 0;
+    #pragma omp parallel for default(none) reduction(+:numHits)
+    for( long long n = 0; n < NUMTRIALS; n++ )
+    {
+        Store xc, yc, r;
+        PrecisionCircle( n, &xc, &yc, &r );
+        numHits += Bounce<Store, Calc>( xc, yc, r );
+    }
+    return numHits;
+}
+
+// the trials on which Bounce<Store, Calc>( ) and the pure double reference disagree:
+template <typename Store, typename Calc>
+long long
+PrecisionMismatches( )
+{
+    long long numMismatches = 0;
+    #pragma omp parallel for default(none) reduction(+:numMismatches)
+    for( long long n = 0; n < NUMTRIALS; n++ )
+    {
+        Store xc, yc, r;
+        double xcd, ycd, rd;
+        PrecisionCircle( n, &xc, &yc, &r );
+        PrecisionCircle( n, &xcd, &ycd, &rd );
+        numMismatches += Bounce<Store, Calc>( xc, yc, r ) != Bounce<double, double>( xcd, ycd, rd );
+    }
+    return numMismatches;
+}
+
+// one timed pass of one variant, handed to the benchmark engine:
+struct PrecisionRun
+{
+    int       variant;
+    long long numHits;
+};
+
+void
+RunPrecision( void *arg )
+{
+    PrecisionRun *run = (PrecisionRun *)arg;
+    switch( run->variant )
+    {
+        case PREC_FLOAT:    run->numHits = PrecisionHits<float, float>( );      break;
+        case PREC_DOUBLE:   run->numHits = PrecisionHits<double, double>( );    break;
+        case PREC_MIXED:    run->numHits = PrecisionHits<float, double>( );     break;
+    }
+}
+
+// time every variant and compare it with the pure double reference:
+int
+Precision( double tolerance )
+{
+    static const char *NAMES[PREC_NUMVARIANTS] = { "float", "double", "float/double" };
+    long long mismatches[PREC_NUMVARIANTS];
+    mismatches[PREC_FLOAT]  = PrecisionMismatches<float, float>( );
+    mismatches[PREC_DOUBLE] = 0;
+    mismatches[PREC_MIXED]  = PrecisionMismatches<float, double>( );
+
+    PrecisionRun runs[PREC_NUMVARIANTS];
+    struct BenchStats stats[PREC_NUMVARIANTS];
+    for( int v = 0; v < PREC_NUMVARIANTS; v++ )
+    {
+        struct BenchConfig config = BENCH_DEFAULTS;
+        runs[v].variant = v;
+        runs[v].numHits = 0;
+        BenchRun( &config, RunPrecision, &runs[v], &stats[v] );
+    }
+
+    // the cheapest variant that is within tolerance of the reference:
+    double reference = (double)runs[PREC_DOUBLE].numHits / (double)NUMTRIALS;
+    int cheapest = PREC_DOUBLE;
+    printf("RNG: philox, seed %llu, %lld trials, %d threads\n", (unsigned long long)Seed, (long long)NUMTRIALS, NUMT);
+    printf("Storage/Math\tMedian MegaTrials/Sec\tCI +-%%\tHits\tHit probability\t|Diff|\tMismatched trials\tWithin %g\n", tolerance);
+    for( int v = 0; v < PREC_NUMVARIANTS; v++ )
+    {
+        double p = (double)runs[v].numHits / (double)NUMTRIALS;
+        int within = fabs( p - reference ) <= tolerance;
+        if( within && stats[v].median < stats[cheapest].median )
+            cheapest = v;
+        printf("%s\t%8.2lf\t%6.2lf\t%lld\t%.8lf\t%.2le\t%lld\t%s\n", NAMES[v],
+            (double)NUMTRIALS / stats[v].median / 1000000., BenchCIPercent( &stats[v] ),
+            runs[v].numHits, p, fabs( p - reference ), mismatches[v], within ? "yes" : "no");
+    }
+    printf("Cheapest within tolerance: %s\n", NAMES[cheapest]);
+    return 0;
+}
+
+// one timed pass of the case-counting loop, handed to the benchmark engine:
+struct CaseRun
+{
+    int         kernel;
+    const float *xcs, *ycs, *rs;
+    CaseCounts  *counts;
+};
+
+void
+RunCases( void *arg )
+{
+    CaseRun *run = (CaseRun *)arg;
+    TrialsCases( run->kernel, RNG, run->xcs, run->ycs, run->rs, run->counts );
+}
+
+// the case mix of all the trials, and what counting it costs over counting the hits alone:
+int
+Outcomes( int kernel, const float *xcs, const float *ycs, const float *rs )
+{
+    static const char *NAMES[BOUNCE_NUMCASES] = { "A missed", "B engulfed", "C bounced up", "D hit" };
+    CaseCounts *counts = new CaseCounts [NUMT];
+    struct CaseRun caseRun = { kernel, xcs, ycs, rs, counts };
+    struct TrialRun hitRun = { kernel, (float *)xcs, (float *)ycs, (float *)rs, 0 };
+
+    struct BenchConfig config = BENCH_DEFAULTS;
+    struct BenchStats hitStats, caseStats;
+    BenchRun( &config, RunTrials, &hitRun, &hitStats );
+    BenchRun( &config, RunCases, &caseRun, &caseStats );
+
+    long long total[BOUNCE_NUMCASES] = { 0 };
+    long long sum = 0;
+    for( int t = 0; t < NUMT; t++ )
+        for( int c = 0; c < BOUNCE_NUMCASES; c++ )
+            total[c] += counts[t].n[c];
+    for( int c = 0; c < BOUNCE_NUMCASES; c++ )
+        sum += total[c];
+
+    double hitRate = (double)NUMTRIALS / hitStats.median / 1000000.;
+    double caseRate = (double)NUMTRIALS / caseStats.median / 1000000.;
+    printf("RNG: %s, %lld trials, %d threads\n", RNG == RNG_PHILOX ? "philox" : "arrays", (long long)NUMTRIALS, NUMT);
+    printf("Kernel: %s\n", kernel == KERNEL_SIMD ? "simd" : "scalar");
+    printf("Case\tTrials\tFraction\n");
+    for( int c = 0; c < BOUNCE_NUMCASES; c++ )
+        printf("%s\t%lld\t%.6lf\n", NAMES[c], total[c], (double)total[c] / (double)NUMTRIALS);
+    printf("Hit-only MegaTrials/Sec: %8.2lf (CI +-%.2lf%%)\n", hitRate, BenchCIPercent( &hitStats ));
+    printf("Case-count MegaTrials/Sec: %8.2lf (CI +-%.2lf%%)\n", caseRate, BenchCIPercent( &caseStats ));
+    printf("Overhead: %+.2lf%%\n", ( caseStats.median / hitStats.median - 1. ) * 100.);
+
+    delete [] counts;
+    if( sum != NUMTRIALS || total[BOUNCE_HIT] != hitRun.numHits )
+    {
+        printf("Case counts DIFFER from the trials (%lld of %lld) or the hits (%lld)\n", sum, (long long)NUMTRIALS, hitRun.numHits);
+        return 1;
+    }
+    return 0;
+}
+
+// one trial and one block of lanes of the fast-path comparison; NEWTON < 0 is the exact path:
+template <int NEWTON>
+static inline int
+FastOne( float xc, float yc, float r )
+{
+    return NEWTON < 0 ? Bounce( xc, yc, r ) : BounceFast<( NEWTON < 0 ? 0 : NEWTON )>( xc, yc, r );
+}
+
+template <int NEWTON>
+static inline vmask
+FastLanes( const float *xcs, const float *ycs, const float *rs )
+{
+    return NEWTON < 0 ? BounceMask( xcs, ycs, rs ) : BounceMaskFast<( NEWTON < 0 ? 0 : NEWTON )>( xcs, ycs, rs );
+}
+
+// the hits of all the trials through one variant:
+template <int NEWTON>
+long long
+FastHits( int kernel, const float *xcs, const float *ycs, const float *rs )
+{
+    const long long numBlocks = kernel == KERNEL_SIMD ? NUMTRIALS / BOUNCE_LANES : 0;
+    long long numHits = 0;
+    #pragma omp parallel for default(none) shared(xcs,ycs,rs,numBlocks) reduction(+:numHits)
+    for( long long blk = 0; blk < numBlocks; blk++ )
+    {
+        long long n = blk*BOUNCE_LANES;
+        numHits += VCOUNT( FastLanes<NEWTON>( &xcs[n], &ycs[n], &rs[n] ) );
+    }
+    #pragma omp parallel for default(none) shared(xcs,ycs,rs,numBlocks) reduction(+:numHits)
+    for( long long n = numBlocks*BOUNCE_LANES; n < NUMTRIALS; n++ )
+        numHits += FastOne<NEWTON>( xcs[n], ycs[n], rs[n] );
+    return numHits;
+}
+
+// the trials one variant classifies differently from the exact path of the same kernel:
+template <int NEWTON>
+long long
+FastMismatches( int kernel, const float *xcs, const float *ycs, const float *rs )
+{
+    const long long numBlocks = kernel == KERNEL_SIMD ? NUMTRIALS / BOUNCE_LANES : 0;
+    long long numMismatches = 0;
+    #pragma omp parallel for default(none) shared(xcs,ycs,rs,numBlocks) reduction(+:numMismatches)
+    for( long long blk = 0; blk < numBlocks; blk++ )
+    {
+        long long n = blk*BOUNCE_LANES;
+        unsigned int fast = VBITS( FastLanes<NEWTON>( &xcs[n], &ycs[n], &rs[n] ) );
+        unsigned int exact = VBITS( BounceMask( &xcs[n], &ycs[n], &rs[n] ) );
+        numMismatches += __builtin_popcount( fast ^ exact );
+    }
+    #pragma omp parallel for default(none) shared(xcs,ycs,rs,numBlocks) reduction(+:numMismatches)
+    for( long long n = numBlocks*BOUNCE_LANES; n < NUMTRIALS; n++ )
+        numMismatches += FastOne<NEWTON>( xcs[n], ycs[n], rs[n] ) != Bounce( xcs[n], ycs[n], rs[n] );
+    return numMismatches;
+}
+
+// one timed pass of one variant (newton -1 is the exact path), handed to the benchmark engine:
+struct FastRun
+{
+    int         kernel;
+    int         newton;
+    const float *xcs, *ycs, *rs;
+    long long   numHits;
+};
+
+void
+RunFast( void *arg )
+{
+    FastRun *run = (FastRun *)arg;
+    switch( run->newton )
+    {
+        case -1:    run->numHits = FastHits<-1>( run->kernel, run->xcs, run->ycs, run->rs );   break;
+        case 0:     run->numHits = FastHits<0>( run->kernel, run->xcs, run->ycs, run->rs );    break;
+        case 1:     run->numHits = FastHits<1>( run->kernel, run->xcs, run->ycs, run->rs );    break;
+        case 2:     run->numHits = FastHits<2>( run->kernel, run->xcs, run->ycs, run->rs );    break;
+    }
+}
+
+long long
+FastMismatchesOf( int kernel, int newton, const float *xcs, const float *ycs, const float *rs )
+{
+    switch( newton )
+    {
+        case 0:     return FastMismatches<0>( kernel, xcs, ycs, rs );
+        case 1:     return FastMismatches<1>( kernel, xcs, ycs, rs );
+        case 2:     return FastMismatches<2>( kernel, xcs, ycs, rs );
+    }
+    return 0;
+}
+
+// time the exact and fast paths of both kernels and compare their classifications:
+int
+FastMath( )
+{
+    // on the PAGES kind of page like the other kernels' arrays, each page first touched by
+    // the thread whose static share of the trials it holds:
+    size_t arrayBytes = (size_t)NUMTRIALS * sizeof(float);
+    float *xcs = (float *)PageAlloc( arrayBytes, PAGES );
+    float *ycs = (float *)PageAlloc( arrayBytes, PAGES );
+    float *rs  = (float *)PageAlloc( arrayBytes, PAGES );
+    if( xcs == NULL || ycs == NULL || rs == NULL )
+    {
+        fprintf( stderr, "Cannot allocate the random-value arrays\n" );
+        PageFree( xcs, arrayBytes, PAGES );
+        PageFree( ycs, arrayBytes, PAGES );
+        PageFree( rs, arrayBytes, PAGES );
+        return 1;
+    }
+    #pragma omp parallel for default(none) shared(xcs,ycs,rs)
+    for( long long n = 0; n < NUMTRIALS; n++ )
+        PhiloxCircle( n, &xcs[n], &ycs[n], &rs[n] );
+
+    printf("RNG: philox, seed %llu, %lld trials in arrays, %d threads, %d SIMD lanes\n",
+        (unsigned long long)Seed, (long long)NUMTRIALS, NUMT, BOUNCE_LANES);
+    printf("Kernel\tPath\tMedian MegaTrials/Sec\tCI +-%%\tSpeedup\tHits\tHit probability\t|Diff|\tMismatched trials\n");
+    for( int kernel = KERNEL_SCALAR; kernel <= KERNEL_SIMD; kernel++ )
+    {
+        double exactMedian = 0.;
+        long long exactHits = 0;
+        for( int newton = -1; newton <= FASTMAXNEWTON; newton++ )
+        {
+            struct BenchConfig config = BENCH_DEFAULTS;
+            struct BenchStats stats;
+            struct FastRun run = { kernel, newton, xcs, ycs, rs, 0 };
+            BenchRun( &config, RunFast, &run, &stats );
+            if( newton < 0 )
+            {
+                exactMedian = stats.median;
+                exactHits = run.numHits;
+            }
+            long long mismatches = newton < 0 ? 0 : FastMismatchesOf( kernel, newton, xcs, ycs, rs );
+
+            char path[32];
+            if( newton < 0 )
+                snprintf( path, sizeof(path), "exact" );
+            else
+                snprintf( path, sizeof(path), "rsqrt/rcp + %d Newton", newton );
+            double p = (double)run.numHits / (double)NUMTRIALS;
+            printf("%s\t%s\t%8.2lf\t%6.2lf\t%5.2lf\t%lld\t%.6lf\t%.2le\t%lld\n",
+                kernel == KERNEL_SIMD ? "simd" : "scalar", path,
+                (double)NUMTRIALS / stats.median / 1000000., BenchCIPercent( &stats ), exactMedian / stats.median,
+                run.numHits, p, fabs( p - (double)exactHits / (double)NUMTRIALS ), mismatches);
+        }
+    }
+
+    PageFree( xcs, arrayBytes, PAGES );
+    PageFree( ycs, arrayBytes, PAGES );
+    PageFree( rs, arrayBytes, PAGES );
+    return 0;
+}
+
+// run every trial once with the selected kernel:
+void
+RunTrials( void *arg )
+{
+    TrialRun *run = (TrialRun *)arg;
+    if( RNG == RNG_CHUNKED )
+        run->numHits = TrialsChunked( run->kernel, 0, NUMCHUNKS );
+    else if( run->kernel == KERNEL_SIMD )
+        run->numHits = TrialsSimd( RNG, run->xcs, run->ycs, run->rs, 0, NUMTRIALS );
+    else
+        run->numHits = TrialsScalar( RNG, run->xcs, run->ycs, run->rs, 0, NUMTRIALS );
+}
@@ -28,7 +28,7 @@ Ranf( int ilow, int ihigh )
 void
 TimeOfDaySeed( )
 {
-	struct tm y2k = { 0 };
+	struct tm y2k = { };
 	y2k.tm_hour = 0;   y2k.tm_min = 0; y2k.tm_sec = 0;
 	y2k.tm_year = 100; y2k.tm_mon = 0; y2k.tm_mday = 1;
 
@@ -0,0 +1,156 @@
+/******************************************************************************
+** Program name: OpenMP: Monte Carlo Simulation
+** Description: This header file places the trials of one replicate in the
+    unit cube of (xc, yc, r) for the variance-reduction modes: plain Monte
+    Carlo, stratified sampling on a K x K x K grid of equal cells, antithetic
+    pairs (u and 1-u), and Latin hypercube sampling. Every point comes from
+    Philox keyed by (trial, replicate, mode), so any trial can be placed by
+    any thread; only the Latin hypercube needs per-replicate permutations,
+    which are shuffled once before the trial loop.
+******************************************************************************/
+
+#ifndef SAMPLING_HPP
+#define SAMPLING_HPP
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "Philox.hpp"
+#include "Xoshiro.hpp"
+
+#define SAMPLE_PLAIN        0
+#define SAMPLE_STRATIFIED   1
+#define SAMPLE_ANTITHETIC   2
+#define SAMPLE_LHS          3
+#define SAMPLE_NUMMODES     4
+
+struct SampleDesign
+{
+    int       mode;
+    uint64_t  seed;
+    uint32_t  replicate;
+    long long n;                // trials asked for
+    long long nEff;             // trials used (whole cells, whole pairs)
+    int       strata;           // cells per dimension (stratified)
+    long long perCell;          // trials per cell (stratified)
+    uint32_t  *perm[3];         // the stratum of each trial in each dimension (LHS)
+};
+
+static inline int
+ParseSampling( const char *s )
+{
+    if( strcmp( s, "plain" ) == 0 )         return SAMPLE_PLAIN;
+    if( strcmp( s, "stratified" ) == 0 )    return SAMPLE_STRATIFIED;
+    if( strcmp( s, "antithetic" ) == 0 )    return SAMPLE_ANTITHETIC;
+    if( strcmp( s, "lhs" ) == 0 )           return SAMPLE_LHS;
+    return -1;
+}
+
+static inline const char *
+SamplingName( int mode )
+{
+    static const char *NAMES[SAMPLE_NUMMODES] = { "plain", "stratified", "antithetic", "lhs" };
+    return NAMES[mode];
+}
+
+// set up replicate number replicate of n trials; returns 0 if the permutations do not fit:
+static inline int
+SampleDesignInit( struct SampleDesign *d, int mode, long long n, uint32_t replicate, uint64_t seed )
+{
+    memset( d, 0, sizeof(*d) );
+    d->mode = mode;
+    d->seed = seed;
+    d->replicate = replicate;
+    d->n = n;
+    d->nEff = n;
+
+    if( mode == SAMPLE_STRATIFIED )
+    {
+        // as many cells as there are trials, and equal trials per cell so the plain mean is unbiased:
+        d->strata = (int)cbrt( (double)n );
+        while( (long long)( d->strata + 1 ) * ( d->strata + 1 ) * ( d->strata + 1 ) <= n )
+            d->strata++;
+        if( d->strata < 1 )
+            d->strata = 1;
+        long long cells = (long long)d->strata * d->strata * d->strata;
+        d->perCell = n / cells;
+        d->nEff = d->perCell * cells;
+    }
+    if( mode == SAMPLE_ANTITHETIC )
+        d->nEff = n / 2 * 2;
+    if( mode == SAMPLE_LHS )
+    {
+        for( int dim = 0; dim < 3; dim++ )
+        {
+            d->perm[dim] = (uint32_t *)malloc( n * sizeof(uint32_t) );
+            if( d->perm[dim] == NULL )
+                return 0;
+        }
+
+        // one Fisher-Yates shuffle per dimension, each from its own stream:
+        #pragma omp parallel for
+        for( int dim = 0; dim < 3; dim++ )
+        {
+            Xoshiro128 g = XoshiroChunk( seed ^ ( (uint64_t)replicate << 32 ), (uint64_t)dim );
+            uint32_t *p = d->perm[dim];
+            for( long long i = 0; i < n; i++ )
+                p[i] = (uint32_t)i;
+            for( long long i = n-1; i > 0; i-- )
+            {
+                long long j = (long long)( ( (uint64_t)XoshiroNext( &g ) * (uint64_t)( i + 1 ) ) >> 32 );
+                uint32_t t = p[i];  p[i] = p[j];  p[j] = t;
+            }
+        }
+    }
+    return 1;
+}
+
+static inline void
+SampleDesignFree( struct SampleDesign *d )
+{
+    for( int dim = 0; dim < 3; dim++ )
+        free( d->perm[dim] );
+}
+
+// a uniform in [0,1) from one random word (24 bits, so every value is exact in a float):
+static inline double
+SampleUnit( uint32_t word )
+{
+    return (double)( word >> 8 ) * ( 1. / 16777216. );
+}
+
+// the point of trial i (0 <= i < nEff) in the unit cube:
+static inline void
+SamplePoint( const struct SampleDesign *d, long long i, double u[3] )
+{
+    long long key = d->mode == SAMPLE_ANTITHETIC ? i / 2 : i;
+    Philox4 w = Philox4x32( (uint32_t)key, (uint32_t)( key >> 32 ), d->replicate, (uint32_t)d->mode,
+                            (uint32_t)d->seed, (uint32_t)( d->seed >> 32 ) );
+    for( int dim = 0; dim < 3; dim++ )
+        u[dim] = SampleUnit( w.v[dim] );
+
+    switch( d->mode )
+    {
+        case SAMPLE_STRATIFIED:
+        {
+            long long cell = i / d->perCell;
+            long long k = d->strata;
+            long long c[3] = { cell % k, ( cell / k ) % k, cell / ( k*k ) };
+            for( int dim = 0; dim < 3; dim++ )
+                u[dim] = ( (double)c[dim] + u[dim] ) / (double)k;
+            break;
+        }
+        case SAMPLE_ANTITHETIC:
+            if( i % 2 == 1 )
+                for( int dim = 0; dim < 3; dim++ )
+                    u[dim] = 1. - u[dim];
+            break;
+        case SAMPLE_LHS:
+            for( int dim = 0; dim < 3; dim++ )
+                u[dim] = ( (double)d->perm[dim][i] + u[dim] ) / (double)d->n;
+            break;
+    }
+}
+
+#endif
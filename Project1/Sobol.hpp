@@ -0,0 +1,112 @@
+/******************************************************************************
+** Program name: OpenMP: Monte Carlo Simulation
+** Description: This header file generates the 3-dimensional Sobol sequence
+    (direction numbers of Joe and Kuo, new-joe-kuo-6.21201) for the
+    quasi-Monte Carlo engine. Any point can be computed directly from its
+    index, so every thread skips ahead to the start of its own block and then
+    steps through it in Gray-code order with one XOR per coordinate. Each
+    replicate applies an independent Owen (nested uniform) scramble, done with
+    the hash-based permutation of Laine and Karras as refined by Burley, so
+    that the spread of the replicates gives an error estimate.
+******************************************************************************/
+
+#ifndef SOBOL_HPP
+#define SOBOL_HPP
+
+#include <stdint.h>
+#include "Xoshiro.hpp"
+
+#define SOBOL_DIMS      3
+#define SOBOL_BITS      32
+
+struct Sobol
+{
+    uint32_t v[SOBOL_DIMS][SOBOL_BITS];     // direction numbers, as 32-bit binary fractions
+};
+
+// dimension 1 is van der Corput; dimensions 2 and 3 are (s=1, a=0, m=1) and (s=2, a=1, m=1,3):
+static inline void
+SobolInit( struct Sobol *sob )
+{
+    static const int      S[SOBOL_DIMS]    = { 0, 1, 2 };
+    static const uint32_t A[SOBOL_DIMS]    = { 0, 0, 1 };
+    static const uint32_t M[SOBOL_DIMS][2] = { { 0, 0 }, { 1, 0 }, { 1, 3 } };
+
+    for( int k = 0; k < SOBOL_BITS; k++ )
+        sob->v[0][k] = 1u << ( 31 - k );
+
+    for( int dim = 1; dim < SOBOL_DIMS; dim++ )
+    {
+        int s = S[dim];
+        uint32_t *v = sob->v[dim];
+        for( int k = 0; k < s; k++ )
+            v[k] = M[dim][k] << ( 31 - k );
+        for( int k = s; k < SOBOL_BITS; k++ )
+        {
+            v[k] = v[k-s] ^ ( v[k-s] >> s );
+            for( int j = 1; j < s; j++ )
+                if( ( A[dim] >> ( s - 1 - j ) ) & 1 )
+                    v[k] ^= v[k-j];
+        }
+    }
+}
+
+// the point at Gray-code position i, computed directly (the skip-ahead):
+static inline void
+SobolPoint( const struct Sobol *sob, uint32_t i, uint32_t x[SOBOL_DIMS] )
+{
+    uint32_t g = i ^ ( i >> 1 );
+    for( int dim = 0; dim < SOBOL_DIMS; dim++ )
+    {
+        x[dim] = 0;
+        for( int k = 0; k < SOBOL_BITS && ( g >> k ) != 0; k++ )
+            if( ( g >> k ) & 1 )
+                x[dim] ^= sob->v[dim][k];
+    }
+}
+
+// from Gray-code position i to i+1 (the last position, 2^32-1, has no next and is left as is):
+static inline void
+SobolNext( const struct Sobol *sob, uint32_t i, uint32_t x[SOBOL_DIMS] )
+{
+    if( i == UINT32_MAX )
+        return;
+    int k = __builtin_ctz( i + 1 );
+    for( int dim = 0; dim < SOBOL_DIMS; dim++ )
+        x[dim] ^= sob->v[dim][k];
+}
+
+static inline uint32_t
+SobolReverse( uint32_t x )
+{
+    x = ( ( x >> 1 ) & 0x55555555u ) | ( ( x & 0x55555555u ) << 1 );
+    x = ( ( x >> 2 ) & 0x33333333u ) | ( ( x & 0x33333333u ) << 2 );
+    x = ( ( x >> 4 ) & 0x0F0F0F0Fu ) | ( ( x & 0x0F0F0F0Fu ) << 4 );
+    x = ( ( x >> 8 ) & 0x00FF00FFu ) | ( ( x & 0x00FF00FFu ) << 8 );
+    return ( x >> 16 ) | ( x << 16 );
+}
+
+// Owen scrambling: every bit is flipped by a hash of the bits above it, so the scrambled
+// points keep the stratification of the originals while being uniformly random each:
+static inline uint32_t
+SobolScramble( uint32_t x, uint32_t seed )
+{
+    x = SobolReverse( x );
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return SobolReverse( x );
+}
+
+// the scramble seed of each dimension for one replicate:
+static inline void
+SobolSeeds( uint64_t seed, uint32_t replicate, uint32_t seeds[SOBOL_DIMS] )
+{
+    uint64_t x = seed ^ ( ( (uint64_t)replicate + 1 ) * 0xD1B54A32D192ED03ULL );
+    for( int dim = 0; dim < SOBOL_DIMS; dim++ )
+        seeds[dim] = (uint32_t)SplitMix64( &x );
+}
+
+#endif
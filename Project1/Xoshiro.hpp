@@ -0,0 +1,71 @@
+/******************************************************************************
+** Program name: OpenMP: Monte Carlo Simulation
+** Description: This header file implements xoshiro128** (Blackman and Vigna),
+    a small, fast sequential generator, seeded through SplitMix64 so that
+    every (seed, chunk) pair starts its own well-mixed stream. A chunk of
+    trials draws its numbers in order from its own stream, so the numbers a
+    trial sees depend only on the seed and its place in the trial space, never
+    on which thread ran the chunk or when.
+******************************************************************************/
+
+#ifndef XOSHIRO_HPP
+#define XOSHIRO_HPP
+
+#include <stdint.h>
+
+struct Xoshiro128
+{
+    uint32_t s[4];
+};
+
+static inline uint64_t
+SplitMix64( uint64_t *x )
+{
+    uint64_t z = ( *x += 0x9E3779B97F4A7C15ULL );
+    z = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9ULL;
+    z = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EBULL;
+    return z ^ ( z >> 31 );
+}
+
+// the stream of one chunk: the chunk number is folded into the SplitMix64 state before
+// it is stepped, so neighboring chunks start from unrelated states:
+static inline struct Xoshiro128
+XoshiroChunk( uint64_t seed, uint64_t chunk )
+{
+    uint64_t x = seed ^ ( ( chunk + 1 ) * 0xD1B54A32D192ED03ULL );
+    uint64_t a = SplitMix64( &x );
+    uint64_t b = SplitMix64( &x );
+    struct Xoshiro128 g = { { (uint32_t)a, (uint32_t)( a >> 32 ), (uint32_t)b, (uint32_t)( b >> 32 ) } };
+    return g;
+}
+
+static inline uint32_t
+XoshiroRotl( uint32_t x, int k )
+{
+    return ( x << k ) | ( x >> ( 32 - k ) );
+}
+
+static inline uint32_t
+XoshiroNext( struct Xoshiro128 *g )
+{
+    uint32_t *s = g->s;
+    uint32_t result = XoshiroRotl( s[1] * 5, 7 ) * 9;
+    uint32_t t = s[1] << 9;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = XoshiroRotl( s[3], 11 );
+    return result;
+}
+
+// a float between low and high from the next word (the top 24 bits, so every value is exact):
+static inline float
+XoshiroRanf( struct Xoshiro128 *g, float low, float high )
+{
+    float t = (float)( XoshiroNext( g ) >> 8 ) * ( 1.f / 16777216.f );     // 0. - 1.
+    return low + t * ( high - low );
+}
+
+#endif
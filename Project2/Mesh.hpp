@@ -0,0 +1,164 @@
+/******************************************************************************
+** Program name: OpenMP: Numeric Integration with OpenMP
+** Description: This header file loads a mesh of Bezier patch pairs from a
+    text file. Each patch is XMIN XMAX YMIN YMAX followed by its 16 top and
+    then its 16 bottom control heights (TOPZ00 TOPZ01 ... TOPZ33, first index
+    along u, as in Proj2.hpp), laid out any way across lines of any length
+    (the file is read a number at a time), with '#' starting a comment. Only
+    the difference of the two nets matters to the volume, so each patch is
+    kept as one 16-float net of top minus bottom: 64 bytes, one cache line,
+    with all the patches back to back.
+******************************************************************************/
+
+#ifndef MESH_HPP
+#define MESH_HPP
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define MESH_NETSIZE    16              // floats in one patch's difference net
+#define MESH_VALUES     ( 4 + 2*MESH_NETSIZE )
+#define MESH_ALIGN      64
+#define MESH_TOKEN      128             // characters kept of one number (longer ones are an error)
+
+struct Mesh
+{
+    int     numPatches;
+    float   *net;                       // TOPZij - BOTZij of patch p at net[MESH_NETSIZE*p + 4*i + j]
+    float   *tileArea;                  // the area of one full-sized tile of each patch
+    double  *area;                      // (XMAX - XMIN) * (YMAX - YMIN) of each patch
+};
+
+static inline void
+MeshFree( struct Mesh *mesh )
+{
+    free( mesh->net );
+    free( mesh->tileArea );
+    free( mesh->area );
+    mesh->net = mesh->tileArea = NULL;
+    mesh->area = NULL;
+    mesh->numPatches = 0;
+}
+
+// grow the patch arrays to hold max patches; returns 0 if out of memory:
+static inline int
+MeshGrow( struct Mesh *mesh, int max )
+{
+    size_t netBytes = ( (size_t)max * MESH_NETSIZE * sizeof(float) + MESH_ALIGN-1 ) / MESH_ALIGN * MESH_ALIGN;
+    float *net = (float *)aligned_alloc( MESH_ALIGN, netBytes );
+    float *tileArea = (float *)malloc( (size_t)max * sizeof(float) );
+    double *area = (double *)malloc( (size_t)max * sizeof(double) );
+    if( net == NULL || tileArea == NULL || area == NULL )
+    {
+        free( net );
+        free( tileArea );
+        free( area );
+        return 0;
+    }
+    if( mesh->numPatches > 0 )
+    {
+        memcpy( net, mesh->net, (size_t)mesh->numPatches * MESH_NETSIZE * sizeof(float) );
+        memcpy( tileArea, mesh->tileArea, (size_t)mesh->numPatches * sizeof(float) );
+        memcpy( area, mesh->area, (size_t)mesh->numPatches * sizeof(double) );
+    }
+    free( mesh->net );
+    free( mesh->tileArea );
+    free( mesh->area );
+    mesh->net = net;
+    mesh->tileArea = tileArea;
+    mesh->area = area;
+    return 1;
+}
+
+// read the patches of path ('-' is stdin) for a grid of numNodes x numNodes nodes on each;
+// returns the number of patches (0 on error):
+static inline int
+ReadMesh( const char *path, int numNodes, struct Mesh *mesh )
+{
+    memset( mesh, 0, sizeof(*mesh) );
+    FILE *fp = strcmp( path, "-" ) == 0 ? stdin : fopen( path, "r" );
+    if( fp == NULL )
+    {
+        fprintf( stderr, "Cannot open '%s'\n", path );
+        return 0;
+    }
+
+    int max = 0;
+    int ok = 1;
+    double values[MESH_VALUES];
+    int numValues = 0;
+    char token[MESH_TOKEN];
+    int lineNum = 1;
+    int ch = getc( fp );
+    while( ok && ch != EOF )
+    {
+        // skip the white space and comments between numbers, counting the lines:
+        if( ch == '#' )
+        {
+            while( ch != '\n' && ch != EOF )
+                ch = getc( fp );
+            continue;
+        }
+        if( isspace( ch ) )
+        {
+            lineNum += ch == '\n';
+            ch = getc( fp );
+            continue;
+        }
+
+        // one number, however long the line it is on:
+        int len = 0;
+        while( ch != EOF && ch != '#' && !isspace( ch ) && len < MESH_TOKEN-1 )
+        {
+            token[len++] = (char)ch;
+            ch = getc( fp );
+        }
+        token[len] = '\0';
+        int tooLong = ch != EOF && ch != '#' && !isspace( ch );
+        char *end;
+        double x = strtod( token, &end );
+        if( tooLong || *end != '\0' )
+        {
+            fprintf( stderr, "%s:%d: not a number: %s%s\n", path, lineNum, token, tooLong ? "..." : "" );
+            ok = 0;
+            break;
+        }
+        values[numValues++] = x;
+        if( numValues < MESH_VALUES )
+            continue;
+
+        // a whole patch:
+        if( mesh->numPatches == max )
+        {
+            max = max == 0 ? 1024 : 2*max;
+            if( !MeshGrow( mesh, max ) )
+            {
+                fprintf( stderr, "Out of memory at patch %d\n", mesh->numPatches );
+                ok = 0;
+                break;
+            }
+        }
+        float *net = &mesh->net[MESH_NETSIZE * mesh->numPatches];
+        for( int k = 0; k < MESH_NETSIZE; k++ )
+            net[k] = (float)( values[4 + k] - values[4 + MESH_NETSIZE + k] );
+        mesh->tileArea[mesh->numPatches] = (float)( ( ( values[1] - values[0] ) / (double)(numNodes-1) ) *
+                                                    ( ( values[3] - values[2] ) / (double)(numNodes-1) ) );
+        mesh->area[mesh->numPatches] = ( values[1] - values[0] ) * ( values[3] - values[2] );
+        mesh->numPatches++;
+        numValues = 0;
+    }
+    if( ok && numValues != 0 )
+    {
+        fprintf( stderr, "%s: the last patch has %d of its %d values\n", path, numValues, MESH_VALUES );
+        ok = 0;
+    }
+    if( fp != stdin )
+        fclose( fp );
+    if( !ok )
+        MeshFree( mesh );
+    return mesh->numPatches;
+}
+
+#endif
@@ -10,12 +10,101 @@
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <omp.h>
 #include "Proj2.hpp"
+#include "Mesh.hpp"
+#include "../Common/Bench.h"
+
+// usage:  ./Proj2 [-s | -r] [-m meshfile]
+//         ./Proj2 -a tolerance [-p] [-m meshfile]
+//         ./Proj2 -e levels [-p]
+//      -s times the separable path (SeparableVolume( ): per-axis basis sums, O(NUMNODES))
+//      instead of the brute-force loop over all NUMNODES^2 nodes, and, for grids up to
+//      CHECKMAXNODES nodes on a side, checks its volume against one brute-force pass;
+//      -m integrates every patch pair of meshfile (see Mesh.hpp; '-' is stdin) instead
+//      of the built-in one, on NUMNODES x NUMNODES nodes each, with the threads sharing
+//      out (patch, MESHROWS rows of nodes) items whose sums are added up in a fixed
+//      order (so the volumes are the same for any NUMT), and prints the volume of
+//      each patch and the total; with -s it also prints each patch's separable
+//      volume and the difference;
+//      -r times the row evaluator (RowSum( ): each row's cubic in power form, Horner's
+//      rule over a SIMD lane per node, the rows shared out over the threads) against
+//      the Height( ) loop, and fails if the volumes differ by more than ROWTOLERANCE
+//      (relative); the mesh engine always evaluates its rows with RowSum( );
+//      -a ignores NUMNODES and integrates adaptively: a cell's 3x3-point Gauss-Legendre
+//      estimate is checked against the sum of its four quarters', and a cell whose two
+//      differ by more than its share (by area) of the absolute tolerance is split, the
+//      whole patch always at least once, the patches (with -m, each getting an equal share of
+//      the tolerance) and the quarters near the root running as OpenMP tasks; it prints
+//      the volume, the error estimate, the height evaluations and the time, and fails
+//      with "NOT reached" if the estimate is above the tolerance or a cell hit
+//      ADAPTMAXDEPTH without meeting its share; the bicubic height is integrated exactly
+//      by the first four cells, so -p integrates only where the top surface is above
+//      the bottom one (the positive part of the height), whose kink along the curve
+//      where they cross is what the refinement is for; that needs a mesh whose
+//      surfaces cross, as the built-in ones never do (their difference net is all
+//      >= 0), so the built-in patch takes four cells, 189 evaluations, with or without -p;
+//      -e computes the trapezoid volume of the built-in patch, or with -m the total of
+//      every patch of meshfile, on levels+1 nested grids of NUMNODES, 2*NUMNODES-1,
+//      4*NUMNODES-3, ... nodes on a side (per patch), evaluating only
+//      the nodes each level adds to the one before, extrapolates them with Romberg's
+//      table (the trapezoid error of a smooth height goes in even powers of the node
+//      spacing), and prints each level's trapezoid and extrapolated volumes and error
+//      estimates against the evaluations spent so far, with the nodes the trapezoid
+//      rule alone would need for the same error; with -p on a mesh whose surfaces
+//      cross, the kink breaks the power series and the extrapolation gains little,
+//      which the estimates show, while on the built-in patch -p changes nothing
+
+// the largest grid whose separable volume is checked against the brute-force loop:
+#ifndef CHECKMAXNODES
+#define CHECKMAXNODES	8192
+#endif
+
+// nodes per float partial sum of a row, so that long rows still add up in double:
+#define ROWBLOCK	1024
+
+// rows of one patch in one work item of the mesh engine:
+#define MESHROWS	16
+#define MESHROWBLOCKS	( ( NUMNODES + MESHROWS - 1 ) / MESHROWS )
+
+// the relative difference allowed between the row evaluator and the Height( ) loop:
+#ifndef ROWTOLERANCE
+#define ROWTOLERANCE	1.e-5
+#endif
+
+// the adaptive integrator's shallowest and deepest accepted cells, and the depth below which
+// cells stop spawning tasks:
+#define ADAPTMINDEPTH	1
+#define ADAPTMAXDEPTH	24
+#define ADAPTTASKDEPTH	6
+
+// Gauss-Legendre points and weights on [0,1], and the height evaluations of one cell:
+#define GAUSSPOINTS	3
+#define GAUSSEVALS	( GAUSSPOINTS * GAUSSPOINTS )
+const double GAUSSX[GAUSSPOINTS] = { 0.1127016653792583, 0.5, 0.8872983346207417 };
+const double GAUSSW[GAUSSPOINTS] = { 5./18., 8./18., 5./18. };
+
+// the most grid doublings -e will do (the finest grid, ( NUMNODES - 1 ) * 2^levels + 1
+// nodes on a side, must also fit an int):
+#define ROMBERGMAXLEVELS	16
 
 // function prototypes:
 float Height( int, int );
+void  RunVolume( void * );
+void  RunSeparable( void * );
+void  RunRows( void * );
+int   AdaptiveMain( double, int, const char * );
+int   RombergMain( int, int, const char * );
+int   MeshMain( const char *, int );
+
+// one timed pass over all the nodes, handed to the benchmark engine:
+struct VolumeRun
+{
+    float  fullTileArea;
+    double volume;
+};
 
 // main program:
 int main( int argc, char *argv[ ] )
@@ -24,64 +113,739 @@ int main( int argc, char *argv[ ] )
 	fprintf( stderr, "No OpenMP support!\n" );
 	return 1;
 #endif
+    int separable = 0;
+    int rows = 0;
+    int positive = 0;
+    double tolerance = 0.;
+    int levels = -1;
+    const char *meshFile = NULL;
+    for( int a = 1; a < argc; a++ )
+    {
+        if( strcmp( argv[a], "-s" ) == 0 )
+        {
+            separable = 1;
+            continue;
+        }
+        if( strcmp( argv[a], "-r" ) == 0 )
+        {
+            rows = 1;
+            continue;
+        }
+        if( strcmp( argv[a], "-a" ) == 0 && a+1 < argc )
+        {
+            tolerance = atof( argv[++a] );
+            if( tolerance <= 0. )
+            {
+                fprintf( stderr, "Bad tolerance '%s'\n", argv[a] );
+                return 1;
+            }
+            continue;
+        }
+        if( strcmp( argv[a], "-e" ) == 0 && a+1 < argc )
+        {
+            levels = atoi( argv[++a] );
+            if( levels < 0 || levels > ROMBERGMAXLEVELS ||
+                (long long)( NUMNODES - 1 ) << levels >= 0x7FFFFFFFLL )
+            {
+                fprintf( stderr, "Bad number of levels '%s' (0 to %d, and a grid that fits an int)\n", argv[a], ROMBERGMAXLEVELS );
+                return 1;
+            }
+            continue;
+        }
+        if( strcmp( argv[a], "-p" ) == 0 )
+        {
+            positive = 1;
+            continue;
+        }
+        if( strcmp( argv[a], "-m" ) == 0 && a+1 < argc )
+        {
+            meshFile = argv[++a];
+            continue;
+        }
+        fprintf( stderr, "Usage: %s [-s | -r] [-m meshfile] | -a tolerance [-p] [-m meshfile] | -e levels [-p] [-m meshfile]\n", argv[0] );
+        return 1;
+    }
+
+    // the options each mode takes, rather than quietly ignoring the others:
+    if( tolerance > 0. && ( separable || rows || levels >= 0 ) )
+    {
+        fprintf( stderr, "-a does not take -s, -r or -e\n" );
+        return 1;
+    }
+    if( positive && tolerance <= 0. && levels < 0 )
+    {
+        fprintf( stderr, "-p only goes with -a or -e\n" );
+        return 1;
+    }
+    if( levels >= 0 && ( separable || rows ) )
+    {
+        fprintf( stderr, "-e does not take -s or -r\n" );
+        return 1;
+    }
+    if( rows && meshFile != NULL )
+    {
+        fprintf( stderr, "-r does not take -m\n" );
+        return 1;
+    }
+
     omp_set_num_threads( NUMT );	
 
+    if( tolerance > 0. )
+        return AdaptiveMain( tolerance, positive, meshFile );
+    if( levels >= 0 )
+        return RombergMain( levels, positive, meshFile );
+    if( meshFile != NULL )
+        return MeshMain( meshFile, separable );
+
     // the area of a single full-sized tile:
     float fullTileArea = (  ( ( XMAX - XMIN )/(float)(NUMNODES-1) )  *
                             ( ( YMAX - YMIN )/(float)(NUMNODES-1) )  );
 
-    // get ready to record the maximum performance and the volume
-    float maxPerformance = 0.;              // must be declared outside the NUMTRIES loop
-    float sumPerformance = 0.;
-    double volume;
-
-    // sum up the weighted heights into the variable "volume"
-    // using an OpenMP for loop and a reduction:
-    for( int t = 0; t < NUMTRIES; t++ )
+    if( rows )
     {
-        double time0 = omp_get_wtime( );    // start timing
-        volume = 0.;                        // accumulate volume 
+        struct BenchConfig config = BENCH_DEFAULTS;
+        struct BenchStats rowStats;
+        struct VolumeRun run = { fullTileArea, 0. };
+        BenchRun( &config, RunRows, &run, &rowStats );
 
-        #pragma omp parallel for default(none) shared(fullTileArea) reduction(+:volume)
-        for( int i = 0; i < NUMNODES*NUMNODES; i++ )
-	{
-            int iu = i % NUMNODES;
-            int iv = i / NUMNODES;
-            float height = Height(iu, iv);
-            float currTileArea = fullTileArea;
+        double nodes = (double)NUMNODES * (double)NUMNODES;
+        BenchPrint( &rowStats, nodes, "Heights" );
+        printf("Num threads: %i\n", NUMT);
+        printf("Num nodes:   %i\n", NUMNODES);
+        printf("Volume:      %.6lf (rows)\n", run.volume);
+        printf("Median perf: %.2lf (rows)\n", nodes / rowStats.median / 1000000.);
+        if( NUMNODES > CHECKMAXNODES )
+            return 0;
 
-            // half area of edge tiles; corner tiles will be halfed twice
-            if (iv == 0 || iv == NUMNODES-1) 
-            {
-                currTileArea *= 0.5;
-            }
-            if (iu == 0 || iu == NUMNODES-1)
-            {
-                currTileArea *= 0.5;
-            }
+        struct BenchStats bruteStats;
+        struct VolumeRun brute = { fullTileArea, 0. };
+        BenchRun( &config, RunVolume, &brute, &bruteStats );
+        double relative = fabs( brute.volume - run.volume ) / fabs( brute.volume );
+        printf("Volume:      %.6lf (Height loop)\n", brute.volume);
+        printf("Median perf: %.2lf (Height loop)\n", nodes / bruteStats.median / 1000000.);
+        printf("Speedup:     %.2lf\n", bruteStats.median / rowStats.median);
+        printf("Relative difference: %.2le (%s %.0le)\n", relative, relative <= ROWTOLERANCE ? "within" : "NOT within", ROWTOLERANCE);
+        return relative <= ROWTOLERANCE ? 0 : 1;
+    }
 
-            volume += ( currTileArea * height ); 
-        }                                   // end (num nodes * num nodes) loop
+    if( separable )
+    {
+        struct BenchConfig config = BENCH_DEFAULTS;
+        struct BenchStats stats;
+        struct VolumeRun run = { fullTileArea, 0. };
+        BenchRun( &config, RunSeparable, &run, &stats );
 
-        // get end time and calculate difference in microseconds
-        double time1 = omp_get_wtime( );    
-        double megaHeightsPerSecond = double(NUMNODES * NUMNODES) / (time1 - time0) / 1000000.;
-        sumPerformance += megaHeightsPerSecond;
+        double nodes = (double)NUMNODES * (double)NUMNODES;
+        BenchPrint( &stats, nodes, "Heights" );
+        printf("Num threads: %i\n", NUMT);
+        printf("Num nodes:   %i\n", NUMNODES);
+        printf("Volume:      %.6lf (separable)\n", run.volume);
+        printf("Median perf: %.2lf (MegaHeights/Sec equivalent)\n", nodes / stats.median / 1000000.);
 
-        if (megaHeightsPerSecond > maxPerformance)
+        // one brute-force pass over the same nodes to check it against:
+        if( NUMNODES <= CHECKMAXNODES )
         {
-            maxPerformance = megaHeightsPerSecond;
+            struct VolumeRun brute = { fullTileArea, 0. };
+            double time0 = omp_get_wtime( );
+            RunVolume( &brute );
+            double seconds = omp_get_wtime( ) - time0;
+            double relative = fabs( brute.volume - run.volume ) / fabs( brute.volume );
+            printf("Brute force: %.6lf in %.3lf sec, relative difference %.2le\n", brute.volume, seconds, relative);
+            printf("Speedup:     %.1lf\n", seconds / stats.median);
         }
+        return 0;
+    }
+
+    // sum up the weighted heights into the variable "volume",
+    // timing it with the benchmark engine (warm-ups, percentiles, run until stable):
+    struct BenchConfig config = BENCH_DEFAULTS;
+    struct BenchStats stats;
+    struct VolumeRun run = { fullTileArea, 0. };
+    BenchRun( &config, RunVolume, &run, &stats );
 
-    }                                       // end num tries loop (find maximum performance)
+    double megaHeightsPerSecond = double(NUMNODES) * double(NUMNODES) / stats.median / 1000000.;
 
+         BenchPrint( &stats, double(NUMNODES) * double(NUMNODES), "Heights" );
          printf("Num threads: %i\n", NUMT);
          printf("Num nodes:   %i\n", NUMNODES);
-         printf("Volume:      %.2lf\n", volume);
-         printf("Peak perf:   %.2lf\n", maxPerformance); 
-         printf("Avg. perf:   %.2lf\n", sumPerformance / (double)NUMTRIES); 
-         printf("\t%.2lf\n", maxPerformance);
+         printf("Volume:      %.2lf\n", run.volume);
+         printf("Median perf: %.2lf\n", megaHeightsPerSecond); 
+         printf("\t%.2lf\n", megaHeightsPerSecond);
         
         return 0;
 }                                               // end main
 
+// the same volume from the separable per-axis sums:
+void RunSeparable( void *arg )
+{
+    VolumeRun *run = (VolumeRun *)arg;
+    run->volume = SeparableVolume( run->fullTileArea );
+}
+
+// the trapezoid-weighted sum of the heights along one row of nodes, whose Bernstein
+// coefficients along u are c[0..3]: the cubic is put in power form once and evaluated
+// by Horner's rule, one node per SIMD lane; every node is summed at weight 1 and the
+// other half of the two end nodes, h(0) = c[0] and h(1) = c[3], comes off at the end:
+static inline double
+RowSum( const float c[4] )
+{
+    const float a0 = c[0];
+    const float a1 = 3.f*( c[1] - c[0] );
+    const float a2 = 3.f*( c[0] - 2.f*c[1] + c[2] );
+    const float a3 = c[3] - 3.f*c[2] + 3.f*c[1] - c[0];
+    const float du = 1.f / (float)(NUMNODES-1);
+
+    double row = 0.;
+    for( int first = 0; first < NUMNODES; first += ROWBLOCK )
+    {
+        int last = first + ROWBLOCK < NUMNODES ? first + ROWBLOCK : NUMNODES;
+        float block = 0.f;
+        #pragma omp simd reduction(+:block)
+        for( int iu = first; iu < last; iu++ )
+        {
+            float u = (float)iu * du;
+            block += ( ( a3*u + a2 )*u + a1 )*u + a0;
+        }
+        row += block;
+    }
+    return row - 0.5 * ( (double)c[0] + (double)c[3] );
+}
+
+// the same volume row by row, the rows shared out over the threads:
+void RunRows( void *arg )
+{
+    VolumeRun *run = (VolumeRun *)arg;
+    double volume = 0.;
+
+    #pragma omp parallel for default(none) reduction(+:volume)
+    for( int iv = 0; iv < NUMNODES; iv++ )
+    {
+        float c[4];
+        RowCoefficients( iv, c );
+        double row = RowSum( c );
+        volume += ( iv == 0 || iv == NUMNODES-1 ) ? 0.5 * row : row;
+    }
+
+    run->volume = run->fullTileArea * volume;
+}
+
+// sum up the weighted heights using an OpenMP for loop and a reduction:
+void RunVolume( void *arg )
+{
+    VolumeRun *run = (VolumeRun *)arg;
+    float fullTileArea = run->fullTileArea;
+    double volume = 0.;                     // accumulate volume 
+
+    #pragma omp parallel for default(none) shared(fullTileArea) reduction(+:volume)
+    for( long long i = 0; i < (long long)NUMNODES*NUMNODES; i++ )
+    {
+        int iu = (int)( i % NUMNODES );
+        int iv = (int)( i / NUMNODES );
+        float height = Height(iu, iv);
+        float currTileArea = fullTileArea;
+
+        // half area of edge tiles; corner tiles will be halfed twice
+        if (iv == 0 || iv == NUMNODES-1) 
+        {
+            currTileArea *= 0.5;
+        }
+        if (iu == 0 || iu == NUMNODES-1)
+        {
+            currTileArea *= 0.5;
+        }
+
+        volume += ( currTileArea * height ); 
+    }                                       // end (num nodes * num nodes) loop
+
+    run->volume = volume;
+}
+
+// the four Bernstein basis values at every row of nodes, shared by all the patches;
+// returns NULL if out of memory:
+float *
+NodeBasis( )
+{
+    float *basis = (float *)aligned_alloc( MESH_ALIGN, ( 4*NUMNODES*sizeof(float) + MESH_ALIGN-1 ) / MESH_ALIGN * MESH_ALIGN );
+    if( basis == NULL )
+        return NULL;
+    for( int i = 0; i < NUMNODES; i++ )
+    {
+        float u = (float)i / (float)(NUMNODES-1);
+        basis[4*i  ] = (1.-u) * (1.-u) * (1.-u);
+        basis[4*i+1] = 3. * u * (1.-u) * (1.-u);
+        basis[4*i+2] = 3. * u * u * (1.-u);
+        basis[4*i+3] = u * u * u;
+    }
+    return basis;
+}
+
+// the volume of every patch, node by node; a work item is MESHROWS rows of one patch,
+// so a few big patches and many small ones both keep every thread busy; each item
+// leaves its sum in its own slot of partials (MESHROWBLOCKS per patch), and each patch
+// adds up its slots in order, so the volumes do not depend on which thread ran what:
+void
+MeshVolumes( const struct Mesh *mesh, const float *basis, double *partials, double *volumes )
+{
+    const int numPatches = mesh->numPatches;
+
+    #pragma omp parallel for collapse(2) schedule(dynamic) default(none) shared(mesh,basis,partials,numPatches)
+    for( int p = 0; p < numPatches; p++ )
+        for( int blk = 0; blk < MESHROWBLOCKS; blk++ )
+        {
+            const float *z = &mesh->net[MESH_NETSIZE*p];
+            int last = ( blk + 1 ) * MESHROWS < NUMNODES ? ( blk + 1 ) * MESHROWS : NUMNODES;
+            double sum = 0.;
+            for( int iv = blk * MESHROWS; iv < last; iv++ )
+            {
+                const float *bv = &basis[4*iv];
+                float c[4];
+                for( int i = 0; i < 4; i++ )
+                    c[i] = z[4*i]*bv[0] + z[4*i+1]*bv[1] + z[4*i+2]*bv[2] + z[4*i+3]*bv[3];
+
+                double row = RowSum( c );
+                if( iv == 0 || iv == NUMNODES-1 )
+                    row *= 0.5;
+                sum += row;
+            }
+            partials[(long long)p * MESHROWBLOCKS + blk] = sum;
+        }
+
+    #pragma omp parallel for default(none) shared(mesh,partials,volumes,numPatches)
+    for( int p = 0; p < numPatches; p++ )
+    {
+        double sum = 0.;
+        for( int blk = 0; blk < MESHROWBLOCKS; blk++ )
+            sum += partials[(long long)p * MESHROWBLOCKS + blk];
+        volumes[p] = mesh->tileArea[p] * sum;
+    }
+}
+
+// one timed pass over every node of every patch, handed to the benchmark engine:
+struct MeshRun
+{
+    const struct Mesh *mesh;
+    const float       *basis;
+    double            *partials;
+    double            *volumes;
+};
+
+void
+RunMesh( void *arg )
+{
+    MeshRun *run = (MeshRun *)arg;
+    MeshVolumes( run->mesh, run->basis, run->partials, run->volumes );
+}
+
+// integrate every patch of the mesh in path and print the per-patch and total volumes:
+int
+MeshMain( const char *path, int separable )
+{
+    struct Mesh mesh;
+    int numPatches = ReadMesh( path, NUMNODES, &mesh );
+    if( numPatches == 0 )
+    {
+        fprintf( stderr, "No patches in '%s'\n", path );
+        return 1;
+    }
+
+    float *basis = NodeBasis( );
+    if( basis == NULL )
+    {
+        fprintf( stderr, "Cannot allocate the node basis\n" );
+        MeshFree( &mesh );
+        return 1;
+    }
+    double *partials = new double [(long long)numPatches * MESHROWBLOCKS];
+    double *volumes = new double [numPatches];
+    struct BenchConfig config = BENCH_DEFAULTS;
+    struct BenchStats stats;
+    struct MeshRun run = { &mesh, basis, partials, volumes };
+    BenchRun( &config, RunMesh, &run, &stats );
+
+    // each patch's separable volume, from the one set of per-axis sums:
+    double su[4];
+    if( separable )
+        BasisSums( su );
+
+    double total = 0.;
+    double maxRelative = 0.;
+    printf( separable ? "Patch\tVolume\tSeparable\tRelative difference\n" : "Patch\tVolume\n" );
+    for( int p = 0; p < numPatches; p++ )
+    {
+        total += volumes[p];
+        if( !separable )
+        {
+            printf("%d\t%.6lf\n", p, volumes[p]);
+            continue;
+        }
+        const float *z = &mesh.net[MESH_NETSIZE*p];
+        double fast = 0.;
+        for( int i = 0; i < 4; i++ )
+            for( int j = 0; j < 4; j++ )
+                fast += (double)z[4*i+j] * su[i] * su[j];
+        fast *= mesh.tileArea[p];
+        double relative = fabs( fast - volumes[p] ) / ( fabs( volumes[p] ) > 0. ? fabs( volumes[p] ) : 1. );
+        if( relative > maxRelative )
+            maxRelative = relative;
+        printf("%d\t%.6lf\t%.6lf\t%.2le\n", p, volumes[p], fast, relative);
+    }
+
+    double heights = (double)numPatches * (double)NUMNODES * (double)NUMNODES;
+    BenchPrint( &stats, heights, "Heights" );
+    printf("Num threads: %i\n", NUMT);
+    printf("Num patches: %i\n", numPatches);
+    printf("Num nodes:   %i per side of each patch\n", NUMNODES);
+    printf("Total volume: %.6lf\n", total);
+    if( separable )
+        printf("Largest separable relative difference: %.2le\n", maxRelative);
+    printf("Median perf: %.2lf\n", heights / stats.median / 1000000.);
+
+    delete [] partials;
+    delete [] volumes;
+    free( basis );
+    MeshFree( &mesh );
+    return 0;
+}
+
+// the totals of a subtree of the adaptive integrator, all over the unit square:
+struct AdaptSum
+{
+    double    volume;
+    double    error;                // the sum of the accepted cells' error estimates
+    long long evals;                // height evaluations
+    long long cells;                // accepted cells
+    long long deep;                 // cells accepted at ADAPTMAXDEPTH without meeting their tolerance
+};
+
+// the 3x3-point Gauss-Legendre estimate of the integral over [u0,u1] x [v0,v1]:
+static double
+GaussCell( const float *net, double u0, double u1, double v0, double v1, int positive )
+{
+    double sum = 0.;
+    for( int i = 0; i < GAUSSPOINTS; i++ )
+        for( int j = 0; j < GAUSSPOINTS; j++ )
+        {
+            double h = HeightAt( net, u0 + GAUSSX[i]*( u1 - u0 ), v0 + GAUSSX[j]*( v1 - v0 ) );
+            if( positive && h < 0. )
+                h = 0.;
+            sum += GAUSSW[i] * GAUSSW[j] * h;
+        }
+    return sum * ( u1 - u0 ) * ( v1 - v0 );
+}
+
+// refine the cell [u0,u1] x [v0,v1], whose own estimate is whole, until its quarters
+// agree with it to within tol; each quarter gets a quarter of the tolerance, its share
+// by area, so the accepted cells' estimates add up to at most the tolerance of the root;
+// the root is always split, as a kink can make one cell's quarters agree with it by chance:
+AdaptSum
+Adapt( const float *net, double u0, double u1, double v0, double v1, double whole, double tol, int depth, int positive )
+{
+    double um = 0.5*( u0 + u1 );
+    double vm = 0.5*( v0 + v1 );
+    double q[4];
+    q[0] = GaussCell( net, u0, um, v0, vm, positive );
+    q[1] = GaussCell( net, um, u1, v0, vm, positive );
+    q[2] = GaussCell( net, u0, um, vm, v1, positive );
+    q[3] = GaussCell( net, um, u1, vm, v1, positive );
+    double quarters = ( q[0] + q[1] ) + ( q[2] + q[3] );
+    double error = fabs( quarters - whole );
+
+    struct AdaptSum sum = { 0., 0., 4*GAUSSEVALS, 0, 0 };
+    if( ( error <= tol && depth >= ADAPTMINDEPTH ) || depth >= ADAPTMAXDEPTH )
+    {
+        sum.volume = quarters;
+        sum.error = error;
+        sum.cells = 1;
+        sum.deep = error > tol;
+        return sum;
+    }
+
+    // the quarters, as tasks near the root and inline below, added up in a fixed order
+    // so the result does not depend on the number of threads:
+    struct AdaptSum child[4];
+    double us[3] = { u0, um, u1 };
+    double vs[3] = { v0, vm, v1 };
+    for( int k = 0; k < 4; k++ )
+    {
+        #pragma omp task default(none) shared(child,us,vs,q) firstprivate(net,k,tol,depth,positive) if( depth < ADAPTTASKDEPTH )
+        child[k] = Adapt( net, us[k%2], us[k%2+1], vs[k/2], vs[k/2+1], q[k], 0.25*tol, depth+1, positive );
+    }
+    #pragma omp taskwait
+
+    for( int k = 0; k < 4; k++ )
+    {
+        sum.volume += child[k].volume;
+        sum.error  += child[k].error;
+        sum.evals  += child[k].evals;
+        sum.cells  += child[k].cells;
+        sum.deep   += child[k].deep;
+    }
+    return sum;
+}
+
+// one timed adaptive integration of every patch, handed to the benchmark engine:
+struct AdaptRun
+{
+    const struct Mesh *mesh;
+    double            tolerance;    // absolute, in the units of the volume, over all the patches
+    int               positive;
+    struct AdaptSum   *sums;        // of each patch, in the x-y units of its domain
+};
+
+void
+RunAdaptive( void *arg )
+{
+    AdaptRun *run = (AdaptRun *)arg;
+    const struct Mesh *mesh = run->mesh;
+
+    #pragma omp parallel default(none) shared(run,mesh)
+    {
+        #pragma omp single
+        {
+            for( int p = 0; p < mesh->numPatches; p++ )
+            {
+                #pragma omp task default(none) shared(run,mesh) firstprivate(p)
+                {
+                    // the patch's share of the tolerance, on its unit square:
+                    const float *net = &mesh->net[MESH_NETSIZE*p];
+                    double area = mesh->area[p];
+                    double tol = run->tolerance / (double)mesh->numPatches / area;
+                    double whole = GaussCell( net, 0., 1., 0., 1., run->positive );
+                    struct AdaptSum sum = Adapt( net, 0., 1., 0., 1., whole, tol, 0, run->positive );
+                    sum.evals += GAUSSEVALS;
+                    sum.volume *= area;
+                    sum.error *= area;
+                    run->sums[p] = sum;
+                }
+            }
+        }
+    }
+}
+
+// every patch of meshFile, or the built-in patch as a mesh of one if it is NULL;
+// returns 0 if there are no patches:
+static int
+LoadMesh( const char *meshFile, struct Mesh *mesh )
+{
+    if( meshFile != NULL )
+    {
+        if( ReadMesh( meshFile, NUMNODES, mesh ) == 0 )
+        {
+            fprintf( stderr, "No patches in '%s'\n", meshFile );
+            return 0;
+        }
+        return mesh->numPatches;
+    }
+
+    memset( mesh, 0, sizeof(*mesh) );
+    if( !MeshGrow( mesh, 1 ) )
+        return 0;
+    BuiltinNet( mesh->net );
+    mesh->area[0] = ( XMAX - XMIN ) * ( YMAX - YMIN );
+    mesh->tileArea[0] = (float)( mesh->area[0] / (double)(NUMNODES-1) / (double)(NUMNODES-1) );
+    mesh->numPatches = 1;
+    return 1;
+}
+
+// integrate the built-in patch, or every patch of meshFile, to the requested absolute
+// tolerance and print what it took:
+int
+AdaptiveMain( double tolerance, int positive, const char *meshFile )
+{
+    struct Mesh mesh;
+    if( LoadMesh( meshFile, &mesh ) == 0 )
+        return 1;
+
+    struct BenchConfig config = BENCH_DEFAULTS;
+    struct BenchStats stats;
+    struct AdaptRun run = { &mesh, tolerance, positive, new AdaptSum [mesh.numPatches] };
+    BenchRun( &config, RunAdaptive, &run, &stats );
+
+    struct AdaptSum total = { 0., 0., 0, 0, 0 };
+    if( meshFile != NULL )
+        printf("Patch\tVolume\tError est.\tEvaluations\tCells\n");
+    for( int p = 0; p < mesh.numPatches; p++ )
+    {
+        struct AdaptSum *s = &run.sums[p];
+        if( meshFile != NULL )
+            printf("%d\t%.10lf\t%.3le\t%lld\t%lld\n", p, s->volume, s->error, s->evals, s->cells);
+        total.volume += s->volume;
+        total.error  += s->error;
+        total.evals  += s->evals;
+        total.cells  += s->cells;
+        total.deep   += s->deep;
+    }
+
+    BenchPrint( &stats, (double)total.evals, "Heights" );
+    printf("Num threads:  %i\n", NUMT);
+    printf("Num patches:  %i\n", mesh.numPatches);
+    printf("Integrand:    %s\n", positive ? "positive part of top - bottom" : "top - bottom");
+    int reached = total.error <= tolerance && total.deep == 0;
+    printf("Tolerance:    %.3le%s\n", tolerance, reached ? "" : " NOT reached");
+    printf("Volume:       %.10lf\n", total.volume);
+    printf("Error est.:   %.3le\n", total.error);
+    printf("Evaluations:  %lld\n", total.evals);
+    printf("Cells:        %lld (%lld at depth %d without meeting their share)\n", total.cells, total.deep, ADAPTMAXDEPTH);
+    printf("Median time:  %.3lf msec\n", stats.median * 1000.);
+
+    delete [] run.sums;
+    MeshFree( &mesh );
+    return reached ? 0 : 1;
+}
+
+// the trapezoid-weighted heights of the nodes of an n x n grid on the unit square that are
+// not on the grid of ( n + 1 ) / 2 nodes it refines (all of them if first): the rows of
+// odd iv are all new, the rows of even iv only at odd iu; each row's cubic along u goes
+// into power form once and is evaluated by Horner's rule, one node per SIMD lane:
+static double
+LevelSum( const float *net, int n, int first, int positive )
+{
+    const double du = 1. / (double)(n-1);
+    double sum = 0.;
+
+    #pragma omp parallel for schedule(dynamic,16) default(none) shared(net,n,first,positive,du) reduction(+:sum)
+    for( int iv = 0; iv < n; iv++ )
+    {
+        double v = (double)iv * du;
+        double bv[4] = { (1.-v) * (1.-v) * (1.-v), 3. * v * (1.-v) * (1.-v), 3. * v * v * (1.-v), v * v * v };
+        double c[4];
+        for( int i = 0; i < 4; i++ )
+            c[i] = bv[0]*net[4*i] + bv[1]*net[4*i+1] + bv[2]*net[4*i+2] + bv[3]*net[4*i+3];
+        const double a0 = c[0];
+        const double a1 = 3.*( c[1] - c[0] );
+        const double a2 = 3.*( c[0] - 2.*c[1] + c[2] );
+        const double a3 = c[3] - 3.*c[2] + 3.*c[1] - c[0];
+
+        // a whole row, or the odd nodes of an old one (none of which is at an end):
+        int whole = first || iv % 2 == 1;
+        int step = whole ? 1 : 2;
+        int start = whole ? 0 : 1;
+        double row = 0.;
+        #pragma omp simd reduction(+:row)
+        for( int iu = start; iu < n; iu += step )
+        {
+            double u = (double)iu * du;
+            double h = ( ( a3*u + a2 )*u + a1 )*u + a0;
+            if( positive )
+                h = h > 0. ? h : 0.;
+            row += ( iu == 0 || iu == n-1 ) ? 0.5 * h : h;
+        }
+        sum += ( iv == 0 || iv == n-1 ) ? 0.5 * row : row;
+    }
+    return sum;
+}
+
+// one timed pass over the whole hierarchy, handed to the benchmark engine:
+struct RombergRun
+{
+    struct Mesh *mesh;
+    int       levels;
+    int       positive;
+    double    *weighted;                                        // each patch's weighted sum so far
+    double    trapezoid[ROMBERGMAXLEVELS+1];
+    double    table[ROMBERGMAXLEVELS+1][ROMBERGMAXLEVELS+1];   // table[k][j]: j extrapolations of level k
+    long long evals[ROMBERGMAXLEVELS+1];                        // height evaluations up to level k
+};
+
+// level k has ( NUMNODES - 1 ) * 2^k + 1 nodes on a side of each patch; a patch's weighted
+// sum is the one before it plus the nodes it adds, so every height is evaluated once over
+// all the levels; the patches are added up in order, and each column of the table cancels
+// the next even power of the spacing:
+void
+RunRomberg( void *arg )
+{
+    RombergRun *run = (RombergRun *)arg;
+    struct Mesh *mesh = run->mesh;
+    for( int p = 0; p < mesh->numPatches; p++ )
+        run->weighted[p] = 0.;
+    for( int k = 0; k <= run->levels; k++ )
+    {
+        int n = ( NUMNODES - 1 ) * ( 1 << k ) + 1;
+        double h = 1. / (double)(n-1);
+        double volume = 0.;
+        for( int p = 0; p < mesh->numPatches; p++ )
+        {
+            run->weighted[p] += LevelSum( &mesh->net[MESH_NETSIZE*p], n, k == 0, run->positive );
+            volume += mesh->area[p] * h * h * run->weighted[p];
+        }
+        run->trapezoid[k] = volume;
+        run->evals[k] = (long long)n * (long long)n * (long long)mesh->numPatches;
+
+        run->table[k][0] = run->trapezoid[k];
+        double four = 1.;
+        for( int j = 1; j <= k; j++ )
+        {
+            four *= 4.;
+            run->table[k][j] = run->table[k][j-1] + ( run->table[k][j-1] - run->table[k-1][j-1] ) / ( four - 1. );
+        }
+    }
+}
+
+// extrapolate the trapezoid volumes of the built-in patch, or of every patch of meshFile,
+// over levels doublings of the grid and print the accuracy each level reached for the
+// evaluations it took:
+int
+RombergMain( int levels, int positive, const char *meshFile )
+{
+    struct Mesh mesh;
+    if( LoadMesh( meshFile, &mesh ) == 0 )
+        return 1;
+
+    struct RombergRun run;
+    memset( &run, 0, sizeof(run) );
+    run.mesh = &mesh;
+    run.levels = levels;
+    run.positive = positive;
+    run.weighted = new double [mesh.numPatches];
+
+    struct BenchConfig config = BENCH_DEFAULTS;
+    struct BenchStats stats;
+    BenchRun( &config, RunRomberg, &run, &stats );
+
+    // every Bernstein cubic integrates to 1/4 over [0,1], so a bicubic's exact volume
+    // is its area times the mean of its net:
+    double exact = 0.;
+    for( int p = 0; p < mesh.numPatches; p++ )
+    {
+        double sum = 0.;
+        for( int k = 0; k < 16; k++ )
+            sum += mesh.net[MESH_NETSIZE*p + k];
+        exact += mesh.area[p] * sum / 16.;
+    }
+
+    // the error estimates are the last two entries of each row (the last extrapolation
+    // against the one before) and, for the trapezoid, its distance from the best value;
+    // the trapezoid error falls as 1/evaluations, so matching an error e from level k takes
+    // evaluations(k) * |trapezoid(k) - best| / e evaluations:
+    printf("Level\tNodes/side\tEvaluations\tTrapezoid\tTrap. error est.\tRomberg\tRomberg error est.\tTrapezoid evaluations for the same error\n");
+    double best = run.table[levels][levels];
+    for( int k = 0; k <= levels; k++ )
+    {
+        int n = ( NUMNODES - 1 ) * ( 1 << k ) + 1;
+        double romberg = run.table[k][k];
+        double trapError = fabs( run.trapezoid[k] - best );
+        double rombergError = k > 0 ? fabs( run.table[k][k] - run.table[k][k-1] ) : trapError;
+        printf("%d\t%d\t%lld\t%.12lf\t%.3le\t%.12lf\t%.3le\t", k, n, run.evals[k], run.trapezoid[k], trapError, romberg, rombergError);
+        if( k > 0 && rombergError > 0. )
+            printf("%.3le\n", (double)run.evals[k] * trapError / rombergError);
+        else
+            printf("-\n");
+    }
+
+    BenchPrint( &stats, (double)run.evals[levels], "Heights" );
+    printf("Num threads:  %i\n", NUMT);
+    printf("Num patches:  %i\n", mesh.numPatches);
+    printf("Num nodes:    %i to %i per side\n", NUMNODES, ( NUMNODES - 1 ) * ( 1 << levels ) + 1);
+    printf("Integrand:    %s\n", positive ? "positive part of top - bottom" : "top - bottom");
+    printf("Volume:       %.12lf (Romberg)\n", best);
+    printf("Trapezoid:    %.12lf (finest grid)\n", run.trapezoid[levels]);
+    if( !positive )
+        printf("Exact:        %.12lf (Romberg error %.2le, trapezoid error %.2le)\n", exact,
+               fabs( best - exact ), fabs( run.trapezoid[levels] - exact ));
+    printf("Evaluations:  %lld\n", run.evals[levels]);
+    printf("Median time:  %.3lf msec\n", stats.median * 1000.);
+
+    delete [] run.weighted;
+    MeshFree( &mesh );
+    return 0;
+}
@@ -15,11 +15,6 @@
 #define NUMNODES	1000
 #endif
 
-// how many tries to discover the maximum performance:
-#ifndef NUMTRIES
-#define NUMTRIES	10
-#endif
-
 #define XMIN	 0.
 #define XMAX	 3.
 #define YMIN	 0.
@@ -100,3 +95,99 @@ Height( int iu, int iv )	// iu,iv = 0 .. NUMNODES-1
         return top - bot;	// if the bottom surface sticks out above the top surface
 				// then that contribution to the overall volume is negative
 }
+
+// the built-in top-minus-bottom control net, laid out like a patch of Mesh.hpp (net[4*i+j]):
+void
+BuiltinNet( float net[16] )
+{
+	const float Z[16] =
+	{
+		TOPZ00-BOTZ00, TOPZ01-BOTZ01, TOPZ02-BOTZ02, TOPZ03-BOTZ03,
+		TOPZ10-BOTZ10, TOPZ11-BOTZ11, TOPZ12-BOTZ12, TOPZ13-BOTZ13,
+		TOPZ20-BOTZ20, TOPZ21-BOTZ21, TOPZ22-BOTZ22, TOPZ23-BOTZ23,
+		TOPZ30-BOTZ30, TOPZ31-BOTZ31, TOPZ32-BOTZ32, TOPZ33-BOTZ33,
+	};
+	for( int k = 0; k < 16; k++ )
+		net[k] = Z[k];
+}
+
+// the top-minus-bottom height of a net at any (u,v) of the unit square, in double,
+// for the adaptive integrator:
+double
+HeightAt( const float net[16], double u, double v )
+{
+	double bu[4] = { (1.-u) * (1.-u) * (1.-u), 3. * u * (1.-u) * (1.-u), 3. * u * u * (1.-u), u * u * u };
+	double bv[4] = { (1.-v) * (1.-v) * (1.-v), 3. * v * (1.-v) * (1.-v), 3. * v * v * (1.-v), v * v * v };
+
+	double height = 0.;
+	for( int i = 0; i < 4; i++ )
+		height += bu[i] * ( bv[0]*net[4*i] + bv[1]*net[4*i+1] + bv[2]*net[4*i+2] + bv[3]*net[4*i+3] );
+	return height;
+}
+
+// the Bernstein coefficients along u of the top-minus-bottom cubic on row iv of nodes:
+// c[i] = sum over j of (TOPZij - BOTZij) Bj(v):
+void
+RowCoefficients( int iv, float c[4] )
+{
+	float v = (float)iv / (float)(NUMNODES-1);
+
+	float bv0 = (1.-v) * (1.-v) * (1.-v);
+	float bv1 = 3. * v * (1.-v) * (1.-v);
+	float bv2 = 3. * v * v * (1.-v);
+	float bv3 = v * v * v;
+
+	c[0] = bv0*(TOPZ00-BOTZ00) + bv1*(TOPZ01-BOTZ01) + bv2*(TOPZ02-BOTZ02) + bv3*(TOPZ03-BOTZ03);
+	c[1] = bv0*(TOPZ10-BOTZ10) + bv1*(TOPZ11-BOTZ11) + bv2*(TOPZ12-BOTZ12) + bv3*(TOPZ13-BOTZ13);
+	c[2] = bv0*(TOPZ20-BOTZ20) + bv1*(TOPZ21-BOTZ21) + bv2*(TOPZ22-BOTZ22) + bv3*(TOPZ23-BOTZ23);
+	c[3] = bv0*(TOPZ30-BOTZ30) + bv1*(TOPZ31-BOTZ31) + bv2*(TOPZ32-BOTZ32) + bv3*(TOPZ33-BOTZ33);
+}
+
+// the trapezoid-weighted sums of the four Bernstein basis functions over the NUMNODES nodes
+// of one axis (weight 1/2 at the two end nodes, like the half tiles of the brute-force loop):
+void
+BasisSums( double sums[4] )
+{
+	double s0 = 0., s1 = 0., s2 = 0., s3 = 0.;
+
+	#pragma omp parallel for default(none) reduction(+:s0,s1,s2,s3)
+	for( int i = 0; i < NUMNODES; i++ )
+	{
+		double u = (double)i / (double)(NUMNODES-1);
+		double w = ( i == 0 || i == NUMNODES-1 ) ? 0.5 : 1.;
+		s0 += w * (1.-u) * (1.-u) * (1.-u);
+		s1 += w * 3. * u * (1.-u) * (1.-u);
+		s2 += w * 3. * u * u * (1.-u);
+		s3 += w * u * u * u;
+	}
+
+	sums[0] = s0;
+	sums[1] = s1;
+	sums[2] = s2;
+	sums[3] = s3;
+}
+
+// the same volume as summing Height( ) over every node, from the per-axis sums in O(NUMNODES):
+// sum over (iu,iv) of w(iu) w(iv) Bi(u) Bj(v) Zij is sum over (i,j) of Zij Su[i] Sv[j]:
+double
+SeparableVolume( double fullTileArea )
+{
+	const double Z[4][4] =
+	{
+		{ TOPZ00-BOTZ00, TOPZ01-BOTZ01, TOPZ02-BOTZ02, TOPZ03-BOTZ03 },
+		{ TOPZ10-BOTZ10, TOPZ11-BOTZ11, TOPZ12-BOTZ12, TOPZ13-BOTZ13 },
+		{ TOPZ20-BOTZ20, TOPZ21-BOTZ21, TOPZ22-BOTZ22, TOPZ23-BOTZ23 },
+		{ TOPZ30-BOTZ30, TOPZ31-BOTZ31, TOPZ32-BOTZ32, TOPZ33-BOTZ33 },
+	};
+
+	// u and v run over the same nodes, so one set of sums serves both axes:
+	double su[4];
+	BasisSums( su );
+	const double *sv = su;
+
+	double volume = 0.;
+	for( int i = 0; i < 4; i++ )
+		for( int j = 0; j < 4; j++ )
+			volume += Z[i][j] * su[i] * sv[j];
+	return fullTileArea * volume;
+}
@@ -11,19 +11,55 @@
 #include <math.h>
 #include "Rand.hpp"
 #include "simd.p4.h"
+#include "../Common/Numa.h"
+#include "../Common/Bench.h"
+#include "../Common/Cache.h"
+
+#ifndef NUMT
+#define NUMT        1
+#endif
 
 #ifndef ARRAYSIZE
 #define ARRAYSIZE   1000
 #endif
 
 #ifndef FUNCTION
-#define FUNCTION    1                           ; function 1 is non-SIMD array multiply
+#define FUNCTION    1                           // function 1 is SIMD array multiply
+#endif
+
+// functions: 1 SIMD multiply, 2 non-SIMD multiply, 3 SIMD multiply-sum, 4 non-SIMD multiply-sum,
+//            5 multiply with streaming stores, 6 multiply that picks 5 above the last-level cache size and 1 below
+#define ISMULTIPLY(f)   ( (f) == 1 || (f) == 2 || (f) == 5 || (f) == 6 )
+
+// PLACE_SERIAL fills the arrays from main; PLACE_FIRSTTOUCH has each thread touch its own chunk first
+#ifndef PLACEMENT
+#define PLACEMENT   PLACE_SERIAL
+#endif
+
+// BIND_NONE, BIND_COMPACT or BIND_SCATTER
+#ifndef BINDING
+#define BINDING     BIND_NONE
+#endif
+
+// PAGES_SMALL, PAGES_THP or PAGES_HUGETLB (falls back to THP, then small, when the pool is empty)
+#ifndef PAGES
+#define PAGES       PAGES_SMALL
+#endif
+
+// DISCOVER=1 sweeps the SimdMulSum working set from 4K to DISCOVERMAX bytes instead of
+// timing FUNCTION, and prints the cache boundaries it finds next to the /sys sizes
+#ifndef DISCOVER
+#define DISCOVER    0
 #endif
 
-#ifndef NUMTRIES
-#define NUMTRIES    10
+#ifndef DISCOVERMAX
+#define DISCOVERMAX (1024.*1024.*1024.)
 #endif
 
+#define DISCOVERMIN     4096.
+#define DISCOVERWORK    (1<<24)     // elements per sample: small working sets repeat the pass
+#define DISCOVERSECONDS 0.5         // sampling budget per working set
+
 // ranges for the random numbers
 const float MIN = -10.;
 const float MAX = 10.;
@@ -47,78 +83,228 @@ float NonSimdMulSum( float *a, float *b, int len )
     return sum;
 }
 
+// per-thread compute time, summed over ThreadCalls runs, for the per-socket bandwidth
+double ThreadTime[NUMA_MAXCPUS];
+int    ThreadCalls;
+
+// one timed pass of the selected function, handed to the benchmark engine
+struct FunctionRun
+{
+    int   function;
+    float *A;
+    float *B;
+    float *C;
+    size_t len;
+    int   reps;
+    float result;
+};
+
+// run the selected function with each thread working on its own chunk of the arrays
+void RunFunction( void *arg )
+{
+    FunctionRun *run = (FunctionRun *)arg;
+    float *A = run->A;
+    float *B = run->B;
+    float *C = run->C;
+    float result = 0.;
+
+    #pragma omp parallel reduction(+:result)
+    {
+        int me = omp_get_thread_num();
+        size_t lo, hi;
+        ChunkRange(run->len, me, omp_get_num_threads(), &lo, &hi);
+        int len = (int)(hi - lo);
+
+        double t0 = omp_get_wtime();
+        for (int r = 0; r < run->reps; r++)
+        {
+            switch (run->function)
+            {
+                case 1: SimdMul(A+lo, B+lo, C+lo, len);
+                        break;
+                case 2: NonSimdMul(A+lo, B+lo, C+lo, len);
+                        break;
+                case 3: result += SimdMulSum(A+lo, B+lo, len);
+                        break;
+                case 4: result += NonSimdMulSum(A+lo, B+lo, len);
+                        break;
+                case 5: StreamMul(A+lo, B+lo, C+lo, len);
+                        break;
+            }
+        }
+        ThreadTime[me] += omp_get_wtime() - t0;
+    }
+
+    run->result = result;
+    ThreadCalls++;
+}
+
+// time one function with the benchmark engine
+void BenchFunction( int function, float *A, float *B, float *C, struct BenchStats *stats )
+{
+    struct BenchConfig config = BENCH_DEFAULTS;
+    struct FunctionRun run = { function, A, B, C, ARRAYSIZE, 1, 0. };
+    BenchRun(&config, RunFunction, &run, stats);
+}
+
+// sweep the SimdMulSum working set (two arrays) on a log scale and find the cache plateaus
+void Discover( float *A, float *B, float *C, size_t maxLen )
+{
+    double ws[CACHE_MAXPOINTS];
+    double bw[CACHE_MAXPOINTS];
+    int numPoints = CacheSweepSizes(DISCOVERMIN, DISCOVERMAX, ws);
+    int bytesPerElem = 2 * sizeof(float);
+
+    struct BenchConfig config = BENCH_DEFAULTS;
+    config.maxSeconds = DISCOVERSECONDS;
+    printf("Working set bytes\tElements\tReps\tMedian GB/s\tCI +-%%\n");
+    for (int i = 0; i < numPoints; i++)
+    {
+        size_t len = (size_t)(ws[i] / (double)bytesPerElem);
+        if (len > maxLen)
+            len = maxLen;
+        int reps = len < DISCOVERWORK ? (int)(DISCOVERWORK / len) : 1;
+
+        struct FunctionRun run = { 3, A, B, C, len, reps, 0. };
+        struct BenchStats stats;
+        BenchRun(&config, RunFunction, &run, &stats);
+
+        ws[i] = (double)len * (double)bytesPerElem;
+        bw[i] = ws[i] * (double)reps / stats.median / 1.e9;
+        printf("%.0lf\t%zu\t%d\t%8.2lf\t%6.2lf\n", ws[i], len, reps, bw[i], BenchCIPercent(&stats));
+    }
+
+    double bounds[CACHE_MAXLEVELS];
+    int numBounds = DetectCacheBoundaries(ws, bw, numPoints, bounds, CACHE_MAXLEVELS);
+    PrintCacheBoundaries(bounds, numBounds);
+}
+
 int main()
 {
 #ifndef _OPENMP
     fprintf(stderr, "OpenMP is not supported here -- sorry.\n");
     return 1;
 #endif
+    if (FUNCTION < 1 || FUNCTION > 6)
+    {
+        printf("Error: no function\n");
+        return 1;
+    }
+
     // seed the random number generator
     TimeOfDaySeed();                            
 
-    // define arrays
-    float *A = new float [ARRAYSIZE];
-    float *B = new float [ARRAYSIZE];
-    float *C = new float [ARRAYSIZE];
+    // bind the threads before anything touches the arrays
+    omp_set_num_threads(NUMT);
+    BindThreads(BINDING);
+
+    // define arrays (fresh pages of the PAGES kind, so the first write decides which socket holds them);
+    // discovery sizes them for its largest working set instead
+    size_t arraySize = DISCOVER ? (size_t)(DISCOVERMAX / (2. * sizeof(float))) + 1 : ARRAYSIZE;
+    size_t arrayBytes = arraySize * sizeof(float);
+    PageMode = PAGES;
+    float *A = (float *)PlaceAlloc(arrayBytes);
+    float *B = (float *)PlaceAlloc(arrayBytes);
+    float *C = (float *)PlaceAlloc(arrayBytes);
+    if (A == NULL || B == NULL || C == NULL)
+    {
+        fprintf(stderr, "Cannot allocate the arrays\n");
+        return 1;
+    }
+
+    // first touch with the same per-thread chunks RunFunction uses
+    if (PLACEMENT == PLACE_FIRSTTOUCH)
+    {
+        #pragma omp parallel
+        {
+            size_t lo, hi;
+            ChunkRange(arraySize, omp_get_thread_num(), omp_get_num_threads(), &lo, &hi);
+            for (size_t i = lo; i < hi; i++)
+            {
+                A[i] = B[i] = C[i] = 0.;
+            }
+        }
+    }
 
-    // fill arrays 
-    for (int i=0; i < ARRAYSIZE; i++)
+    // fill arrays (rand() is not thread safe, so this stays serial; pages are already placed)
+    for (size_t i=0; i < arraySize; i++)
     {
         A[i] = Ranf( MIN, MAX );
         B[i] = Ranf( MIN, MAX );
         C[i] = 0.;
     }
 
-    // variables for performance measurement
-    double maxPerformance = 0.;                   
-    double sumPerformance = 0.;
-
-    // run experiment multiple tries to get best performance
-    for (int t = 0; t < NUMTRIES; t++)
+    if (DISCOVER)
     {
-        // start timing
-        double time0 = omp_get_wtime();         
+        Discover(A, B, C, arraySize);
+        PlaceFree(A, arrayBytes);
+        PlaceFree(B, arrayBytes);
+        PlaceFree(C, arrayBytes);
+        return 0;
+    }
 
-        // run current matrix operation
-        float result = 0.;                                  
-        switch (FUNCTION)
-        {
-            case 1: SimdMul(A, B, C, ARRAYSIZE);         
-                    break;
-            case 2: NonSimdMul(A, B, C, ARRAYSIZE);         
-                    break;
-            case 3: result = SimdMulSum(A, B, ARRAYSIZE); 
-                    break;
-            case 4: result = NonSimdMulSum(A, B, ARRAYSIZE);
-                    break;
-            default: printf("Error: no function\n");
-                    break;
-        }
+    // function 6 streams only when the three arrays overflow the last-level cache of every socket
+    size_t streamThreshold = LastLevelCacheSize() * (size_t)NumaNumSockets;
+    int useStreaming = streamThreshold > 0 && 3*arrayBytes > streamThreshold;
+    int function = FUNCTION == 6 ? ( useStreaming ? 5 : 1 ) : FUNCTION;
 
-        // stop timing
-        double time1 = omp_get_wtime();         
-        
-        // calculate performance and save maximum performance result
-        double performance = (double)ARRAYSIZE/(time1-time0)/1000000.;
-        sumPerformance += performance;
-        if (performance > maxPerformance)
-        {
-            maxPerformance = performance;
-        }
-    }                                           // end num tries loop
+    // run the experiment with the benchmark engine (warm-ups, percentiles, run until stable),
+    // counting dTLB misses on every thread when the PMU allows it
+    TlbOpen();
+    long long tlb0 = TlbRead();
+    struct BenchStats stats;
+    BenchFunction(function, A, B, C, &stats);
+    long long tlb1 = TlbRead();
+    TlbClose();
 
     // print performance results
     printf("\nArray size       = %8d elements\n", ARRAYSIZE);
     printf("Function number  = %8d\n", FUNCTION);
-    printf("Avg. performance = %8.2lf MegaMults/Sec\n", sumPerformance/(double)NUMTRIES);
-    printf("Peak performance = %8.2lf MegaMults/Sec\n", maxPerformance);
-    printf("\t%8.2lf\n", maxPerformance);
+    if (FUNCTION == 6)
+        printf("Picked function  = %8d (%s stores, LLC threshold %zu bytes)\n", function, useStreaming ? "streaming" : "cached", streamThreshold);
+    printf("Threads          = %8d (%s, %s)\n", NUMT, PlacementName(PLACEMENT), BindingName(BINDING));
+    printf("Pages            = %8s (%zu bytes on huge pages, %d fallback(s))\n", PagesName(PAGES), PagesHugeBytes(), PageFallbacks);
+    BenchPrint(&stats, (double)ARRAYSIZE, "Mults");
+    if (tlb0 >= 0 && tlb1 >= 0)
+        printf("dTLB misses      = %8.3lf per 1000 elements\n", (double)(tlb1 - tlb0) / (double)ThreadCalls / (ARRAYSIZE / 1000.));
+    else
+        printf("dTLB misses      = %8s (no counters)\n", "-");
+
+    // each socket moves its threads' chunks in the time of its slowest thread
+    int bytesPerElem = (ISMULTIPLY(FUNCTION) ? 3 : 2) * sizeof(float);
+    for (int sk = 0; sk < NumaNumSockets; sk++)
+    {
+        double socketBytes = 0.;
+        double socketTime = 0.;
+        for (int i = 0; i < NUMT; i++)
+        {
+            if (ThreadSocket[i] != sk)
+                continue;
+            size_t lo, hi;
+            ChunkRange(ARRAYSIZE, i, NUMT, &lo, &hi);
+            socketBytes += (double)(hi - lo) * bytesPerElem;
+            if (ThreadTime[i] > socketTime)
+                socketTime = ThreadTime[i];
+        }
+        socketTime /= (double)ThreadCalls;
+        printf("Socket %d         = %8.2lf GB/s\n", sk, socketTime > 0. ? socketBytes / socketTime / 1.e9 : 0.);
+    }
+
+    // for a multiply, show what both store paths achieve at this size
+    if (ISMULTIPLY(FUNCTION))
+    {
+        struct BenchStats cachedStats, streamStats;
+        BenchFunction(1, A, B, C, &cachedStats);
+        BenchFunction(5, A, B, C, &streamStats);
+        printf("Cached stores    = %8.2lf GB/s\n", (double)bytesPerElem * ARRAYSIZE / cachedStats.median / 1.e9);
+        printf("Streaming stores = %8.2lf GB/s\n", (double)bytesPerElem * ARRAYSIZE / streamStats.median / 1.e9);
+    }
+    printf("\t%8.2lf\n", (double)ARRAYSIZE / stats.median / 1000000.);
 
     // free array memory
-    delete [] A;
-    delete [] B;
-    delete [] C;
+    PlaceFree(A, arrayBytes);
+    PlaceFree(B, arrayBytes);
+    PlaceFree(C, arrayBytes);
 
     return 0;
 }
-
@@ -0,0 +1,346 @@
+/******************************************************************************
+** Program name: OpenMP: Synchronization Overhead Microbenchmarks
+** Description: This main file measures the overhead of each OpenMP construct
+    the projects rely on (parallel regions, for, parallel for, reductions,
+    barriers, single, sections, critical and atomic) against thread count, in
+    the style of the EPCC syncbench: every construct wraps a calibrated delay,
+    and the overhead is the time beyond the same number of delays run serially,
+    divided by the number of times the construct was executed. The break-even
+    column is the smallest amount of serial work a parallel for must contain
+    before it runs faster than the serial loop at that thread count.
+******************************************************************************/
+
+#define _GNU_SOURCE                     // for the cpu affinity calls in Numa.h
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../Common/Numa.h"
+#include "../Common/Bench.h"
+
+// usage:  ./syncbench [-t threads,threads,...] [-b none|compact|scatter] [-d delayusec]
+//      with no -t list, the thread counts are 1, 2, 4, ... up to the number of processors;
+//      each construct wraps a delay of about -d microseconds (default DELAYUSEC),
+//      and is repeated until one sample takes about SAMPLESECONDS
+
+#define MAXTHREADS      64
+#define DELAYUSEC       0.1
+#define SAMPLESECONDS   1.e-3
+
+// iterations of the delay loop that take about DELAYUSEC, found by Calibrate( ):
+int DelayLength;
+
+// shared by the critical, atomic and reduction tests:
+float Counter;
+
+// the EPCC delay: a dependent floating-point chain the compiler cannot fold away
+void Delay( int length )
+{
+    float a = 0.f;
+    for (int i = 0; i < length; i++)
+        a += (float)i;
+    if (a < 0.f)
+        printf("%f\n", a);
+}
+
+// each test executes its construct reps times on the critical path, with one delay inside each:
+void Reference( int reps )
+{
+    for (int j = 0; j < reps; j++)
+        Delay(DelayLength);
+}
+
+void TestParallel( int reps )
+{
+    for (int j = 0; j < reps; j++)
+    {
+        #pragma omp parallel
+        Delay(DelayLength);
+    }
+}
+
+void TestFor( int reps )
+{
+    #pragma omp parallel
+    {
+        int numThreads = omp_get_num_threads();
+        for (int j = 0; j < reps; j++)
+        {
+            #pragma omp for schedule(static)
+            for (int i = 0; i < numThreads; i++)
+                Delay(DelayLength);
+        }
+    }
+}
+
+void TestParallelFor( int reps )
+{
+    int numThreads = omp_get_max_threads();
+    for (int j = 0; j < reps; j++)
+    {
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < numThreads; i++)
+            Delay(DelayLength);
+    }
+}
+
+void TestReduction( int reps )
+{
+    for (int j = 0; j < reps; j++)
+    {
+        float sum = 0.f;
+        #pragma omp parallel reduction(+:sum)
+        {
+            Delay(DelayLength);
+            sum += 1.f;
+        }
+        Counter += sum;
+    }
+}
+
+void TestBarrier( int reps )
+{
+    #pragma omp parallel
+    {
+        for (int j = 0; j < reps; j++)
+        {
+            Delay(DelayLength);
+            #pragma omp barrier
+        }
+    }
+}
+
+void TestSingle( int reps )
+{
+    #pragma omp parallel
+    {
+        for (int j = 0; j < reps; j++)
+        {
+            #pragma omp single
+            Delay(DelayLength);
+        }
+    }
+}
+
+void TestSections( int reps )
+{
+    #pragma omp parallel
+    {
+        for (int j = 0; j < reps; j++)
+        {
+            #pragma omp sections
+            {
+                #pragma omp section
+                Delay(DelayLength);
+            }
+        }
+    }
+}
+
+// every entry is serialized, so the threads share the reps between them:
+void TestCritical( int reps )
+{
+    #pragma omp parallel
+    {
+        int numThreads = omp_get_num_threads();
+        int me = omp_get_thread_num();
+        for (int j = me; j < reps; j += numThreads)
+        {
+            #pragma omp critical
+            {
+                Delay(DelayLength);
+                Counter += 1.f;
+            }
+        }
+    }
+}
+
+// every thread does reps delay-plus-update pairs side by side, so only contention adds to the reference:
+void TestAtomic( int reps )
+{
+    #pragma omp parallel
+    {
+        for (int j = 0; j < reps; j++)
+        {
+            Delay(DelayLength);
+            #pragma omp atomic
+            Counter += 1.f;
+        }
+    }
+}
+
+struct SyncTest
+{
+    const char *name;
+    void      (*func)( int reps );
+};
+
+struct SyncTest TESTS[] =
+{
+    { "parallel",       TestParallel },
+    { "for",            TestFor },
+    { "parallel-for",   TestParallelFor },
+    { "reduction",      TestReduction },
+    { "barrier",        TestBarrier },
+    { "single",         TestSingle },
+    { "sections",       TestSections },
+    { "critical",       TestCritical },
+    { "atomic",         TestAtomic },
+};
+#define NUMTESTS    ( (int)( sizeof(TESTS) / sizeof(TESTS[0]) ) )
+
+// one timed sample of a test, handed to the benchmark engine:
+struct SyncRun
+{
+    void (*func)( int reps );
+    int  reps;
+};
+
+void RunSync( void *arg )
+{
+    const struct SyncRun *run = (const struct SyncRun *)arg;
+    run->func(run->reps);
+}
+
+// find the delay length that takes about delayUsec:
+void Calibrate( double delayUsec )
+{
+    DelayLength = 1;
+    for (;;)
+    {
+        double t0 = omp_get_wtime();
+        Reference(1000);
+        double usec = (omp_get_wtime() - t0) * 1.e6 / 1000.;
+        if (usec >= delayUsec || DelayLength > (1<<24))
+        {
+            DelayLength = (int)((double)DelayLength * delayUsec / usec) + 1;
+            return;
+        }
+        DelayLength *= 2;
+    }
+}
+
+// the number of reps that makes one sample of the test take about SAMPLESECONDS:
+int SampleReps( void (*func)( int reps ) )
+{
+    int reps = 1;
+    for (;;)
+    {
+        double t0 = omp_get_wtime();
+        func(reps);
+        double seconds = omp_get_wtime() - t0;
+        if (seconds >= SAMPLESECONDS || reps >= (1<<24))
+            return reps;
+        reps *= 2;
+    }
+}
+
+// parse a comma-separated thread list such as 1,2,4,8:
+int ParseThreads( const char *s, int *threads, int maxThreads )
+{
+    int num = 0;
+    while (*s != '\0' && num < maxThreads)
+    {
+        char *end;
+        long t = strtol(s, &end, 10);
+        if (end == s || t < 1 || t > NUMA_MAXCPUS)
+            return 0;
+        threads[num++] = (int)t;
+        s = *end == ',' ? end+1 : end;
+    }
+    return num;
+}
+
+int main( int argc, char *argv[] )
+{
+#ifndef _OPENMP
+    fprintf(stderr, "OpenMP is not supported here -- sorry.\n");
+    return 1;
+#endif
+
+    int threads[MAXTHREADS];
+    int numThreads = 0;
+    int binding = BIND_NONE;
+    double delayUsec = DELAYUSEC;
+    for (int a = 1; a < argc; a++)
+    {
+        if (strcmp(argv[a], "-t") == 0 && a+1 < argc)
+        {
+            numThreads = ParseThreads(argv[++a], threads, MAXTHREADS);
+            if (numThreads == 0)
+            {
+                fprintf(stderr, "Bad thread list '%s'\n", argv[a]);
+                return 1;
+            }
+            continue;
+        }
+        if (strcmp(argv[a], "-b") == 0 && a+1 < argc)
+        {
+            binding = ParseBinding(argv[++a]);
+            if (binding < 0)
+            {
+                fprintf(stderr, "Bad binding '%s' (none, compact or scatter)\n", argv[a]);
+                return 1;
+            }
+            continue;
+        }
+        if (strcmp(argv[a], "-d") == 0 && a+1 < argc)
+        {
+            delayUsec = atof(argv[++a]);
+            if (delayUsec <= 0.)
+            {
+                fprintf(stderr, "Bad delay '%s'\n", argv[a]);
+                return 1;
+            }
+            continue;
+        }
+        fprintf(stderr, "Usage: %s [-t threads,...] [-b none|compact|scatter] [-d delayusec]\n", argv[0]);
+        return 1;
+    }
+    if (numThreads == 0)
+    {
+        int numProcs = omp_get_num_procs();
+        for (int t = 1; t < numProcs && numThreads < MAXTHREADS-1; t *= 2)
+            threads[numThreads++] = t;
+        threads[numThreads++] = numProcs;
+    }
+
+    Calibrate(delayUsec);
+    fprintf(stderr, "Delay of %.3lf usec = %d iterations, binding %s\n", delayUsec, DelayLength, BindingName(binding));
+
+    // one tab-separated line per (construct, threads) so it pastes into Excel; the overhead
+    // is per execution of the construct, from the median sample times of test and reference:
+    struct BenchConfig config = BENCH_DEFAULTS;
+    printf("Construct\tThreads\tOverhead usec\tTest CI +-%%\tReference CI +-%%\tReps\tBreak-even usec\n");
+    for (int p = 0; p < numThreads; p++)
+    {
+        omp_set_num_threads(threads[p]);
+        BindThreads(binding);
+
+        for (int t = 0; t < NUMTESTS; t++)
+        {
+            int reps = SampleReps(TESTS[t].func);
+
+            struct SyncRun ref  = { Reference, reps };
+            struct SyncRun test = { TESTS[t].func, reps };
+            struct BenchStats refStats, testStats;
+            BenchRun(&config, RunSync, &ref, &refStats);
+            BenchRun(&config, RunSync, &test, &testStats);
+
+            double overhead = (testStats.median - refStats.median) / (double)reps * 1.e6;
+
+            printf("%s\t%d\t%8.3lf\t%6.2lf\t%6.2lf\t%d\t",
+                TESTS[t].name, threads[p], overhead,
+                BenchCIPercent(&testStats), BenchCIPercent(&refStats), reps);
+
+            // a parallel for of W usec of serial work takes W/p + overhead, which beats W once
+            // W > overhead * p / (p-1):
+            if (TESTS[t].func == TestParallelFor && threads[p] > 1)
+                printf("%8.3lf\n", overhead * (double)threads[p] / (double)(threads[p] - 1));
+            else
+                printf("-\n");
+        }
+    }
+
+    return 0;
+}